@@ -0,0 +1,89 @@
+"use strict";
+
+// Times 16-bit decoding (op_read()) in the float and fixed-point builds of
+// opusfile:
+//
+//   node bench/fixed-point.js [file.opus]
+//
+// The addon is rebuilt with node-gyp once per flavor, ending with the
+// default float build. Without a file, ./test/data/input.opus is transcoded
+// to 48 kHz stereo first. The float build dithers its output, so the PCM of
+// the two builds differs in the lowest bits.
+
+var childProcess = require('child_process');
+var fs = require('fs');
+var path = require('path');
+
+var ROOT = path.join(__dirname, '..');
+var BUILDS = [
+  { name: 'fixed point', args: ['--', '-Dopusfile_fixed_point=1'] },
+  { name: 'float', args: [] }
+];
+var PASSES = 20;
+
+// Decodes file PASSES times with the addon at modulePath and prints
+// {fixedPoint, samples, ms}.
+function run(modulePath, file) {
+  var OpusFile = require(modulePath);
+  var decoder = new OpusFile.OpusDecoder(file);
+  var channels = decoder.channelCount();
+  var pcm = new Int16Array(5760 * channels);
+  var samples = 0;
+  var read;
+
+  var start = process.hrtime();
+  for (var pass = 0; pass < PASSES; pass++) {
+    decoder.pcmSeek(0);
+    while ((read = decoder.readInto(pcm)).samples > 0) {
+      samples += read.samples * channels;
+    }
+  }
+  var elapsed = process.hrtime(start);
+  decoder.close();
+
+  console.log(JSON.stringify({
+    fixedPoint: OpusFile.fixedPoint,
+    samples: samples,
+    ms: elapsed[0] * 1e3 + elapsed[1] / 1e6
+  }));
+}
+
+function compare(file) {
+  var results = BUILDS.map(function(build) {
+    var made = childProcess.spawnSync('node-gyp', ['rebuild'].concat(build.args), { cwd: ROOT, stdio: 'inherit' });
+    if (made.status !== 0) {
+      throw new Error('node-gyp failed for the ' + build.name + ' build');
+    }
+    var modulePath = path.join(ROOT, 'build', 'bench-' + build.name.replace(' ', '-') + '.node');
+    fs.copyFileSync(path.join(ROOT, 'build', 'Release', 'node-opusfile.node'), modulePath);
+
+    var child = childProcess.spawnSync(process.execPath, [__filename, '--run', modulePath, file], {
+      encoding: 'utf8'
+    });
+    if (child.status !== 0) {
+      throw new Error(build.name + ': ' + child.stderr);
+    }
+    var result = JSON.parse(child.stdout);
+    if (result.fixedPoint !== (build.args.length > 0)) {
+      throw new Error('the ' + build.name + ' build did not take effect');
+    }
+    return result;
+  });
+
+  var base = results[results.length - 1];
+  results.forEach(function(result, i) {
+    console.log(BUILDS[i].name + '\t' + (result.samples / result.ms / 1e3).toFixed(1) + ' Msamples/s\t' +
+                (base.ms / result.ms).toFixed(2) + 'x');
+  });
+}
+
+if (process.argv[2] === '--run') {
+  run(process.argv[3], process.argv[4]);
+} else if (process.argv[2]) {
+  compare(path.resolve(process.argv[2]));
+} else {
+  var file = path.join(ROOT, 'test', 'data', 'output-bench-stereo.opus');
+  require('..').normalize(path.join(ROOT, 'test', 'data', 'input.opus'), file,
+                          { sampleRate: 48000, channels: 2, bitrate: 64000 })
+    .then(function() { compare(file); });
+}
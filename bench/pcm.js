@@ -0,0 +1,85 @@
+"use strict";
+
+// Times OpusDecoder.readInto() with each PCM kernel:
+//
+//   node bench/pcm.js [file.opus]
+//
+// Without a file, ./test/data/input.opus is transcoded to 48 kHz stereo
+// first; pass a 5.1 or 7.1 file to time the downmix. The kernels are picked
+// once per process, so each one runs in a child with OPUSFILE_SIMD set, and
+// the decoded PCM of every run is compared with the C code's. 'avx2' falls
+// back to 'sse2' on CPUs without it.
+
+var childProcess = require('child_process');
+var crypto = require('crypto');
+var OpusFile = require('..');
+
+var KERNELS = ['none', 'sse2', 'avx2'];
+var CASES = {
+  'int16 dither': { type: Int16Array, options: {} },
+  'int16': { type: Int16Array, options: { dither: false } },
+  'int16 stereo': { type: Int16Array, options: { stereo: true } },
+  'float stereo': { type: Float32Array, options: { stereo: true } }
+};
+var PASSES = 20;
+
+// Decodes file PASSES times and prints {samples, ms, hash} of the PCM.
+function run(name, file) {
+  var test = CASES[name];
+  var decoder = new OpusFile.OpusDecoder(file, test.options);
+  var channels = test.options.stereo ? 2 : decoder.channelCount();
+  var pcm = new test.type(5760 * channels);
+  var bytes = Buffer.from(pcm.buffer);
+  var hash = crypto.createHash('sha1');
+  var samples = 0;
+  var read;
+  while ((read = decoder.readInto(pcm)).samples > 0) {
+    hash.update(bytes.slice(0, read.samples * channels * pcm.BYTES_PER_ELEMENT));
+  }
+
+  var start = process.hrtime();
+  for (var pass = 0; pass < PASSES; pass++) {
+    decoder.pcmSeek(0);
+    while ((read = decoder.readInto(pcm)).samples > 0) {
+      samples += read.samples * channels;
+    }
+  }
+  var elapsed = process.hrtime(start);
+  decoder.close();
+
+  console.log(JSON.stringify({
+    samples: samples,
+    ms: elapsed[0] * 1e3 + elapsed[1] / 1e6,
+    hash: hash.digest('hex')
+  }));
+}
+
+function compare(file) {
+  Object.keys(CASES).forEach(function(name) {
+    var base = null;
+    KERNELS.forEach(function(kernel) {
+      var child = childProcess.spawnSync(process.execPath, [__filename, '--run', name, file], {
+        env: Object.assign({}, process.env, { OPUSFILE_SIMD: kernel }),
+        encoding: 'utf8'
+      });
+      if (child.status !== 0) {
+        throw new Error(kernel + ': ' + child.stderr);
+      }
+      var result = JSON.parse(child.stdout);
+      base = base || result;
+      console.log(name + '\t' + kernel + '\t' + (result.samples / result.ms / 1e3).toFixed(1) + ' Msamples/s\t' +
+                  (base.ms / result.ms).toFixed(2) + 'x\t' +
+                  (result.hash === base.hash ? 'identical' : 'DIFFERENT OUTPUT'));
+    });
+  });
+}
+
+if (process.argv[2] === '--run') {
+  run(process.argv[3], process.argv[4]);
+} else if (process.argv[2]) {
+  compare(process.argv[2]);
+} else {
+  var file = './test/data/output-bench-stereo.opus';
+  OpusFile.normalize('./test/data/input.opus', file, { sampleRate: 48000, channels: 2, bitrate: 64000 })
+    .then(function() { compare(file); });
+}
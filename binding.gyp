@@ -1,4 +1,8 @@
 {
+  'variables': {
+    # See deps/binding.gyp.
+    'opusfile_fixed_point%': 0
+  },
   "targets": [
     {
       'target_name': 'node-opusfile',
@@ -10,7 +14,44 @@
       ],
       'sources': [
         'src/node-opusfile.cc',
+        'src/alloc_count.cc',
+        'src/metadata_cache.cc',
+        'src/normalizer.cc',
+        'src/options.cc',
+        'src/opus_decoder.cc',
+        'src/opus_writer.cc',
+        'src/page_sink.cc',
+        'src/prefetcher.cc',
+        'src/probe.cc',
+        'src/quick_probe.cc',
+        'src/recorder.cc',
+        'src/resampler.cc',
+        'src/stream_decoder.cc',
+        'src/stream_source.cc',
+      ],
+      'conditions': [
+        ['opusfile_fixed_point==1', {
+          'defines': [ 'OP_FIXED_POINT' ]
+        }]
       ]
     }
+  ],
+  'conditions': [
+    # Counting allocator for the allocation tests; see test/alloc_counter.cc.
+    # Nothing loads it unless it is preloaded.
+    ['OS=="linux"', {
+      'targets': [
+        {
+          'target_name': 'alloc_counter',
+          'type': 'loadable_module',
+          'product_extension': 'so',
+          'sources': [
+            'test/alloc_counter.cc'
+          ],
+          'cflags_cc!': [ '-fno-exceptions' ],
+          'cflags_cc': [ '-fexceptions' ]
+        }
+      ]
+    }]
   ]
 }
@@ -1,6 +1,12 @@
 # Build external deps.
 {
-  'variables': { 'target_arch%': 'x64' },
+  'variables': {
+    'target_arch%': 'x64',
+    # 1 builds the fixed-point decoder, where op_read() takes 16-bit PCM
+    # straight from libopus instead of converting and dithering float:
+    #   node-gyp rebuild -- -Dopusfile_fixed_point=1
+    'opusfile_fixed_point%': 0
+  },
 
   'target_defaults': {
     'default_configuration': 'Debug',
@@ -38,7 +44,8 @@
         'opusfile/src/info.c',
         'opusfile/src/internal.c',
         'opusfile/src/opusfile.c',
-        'opusfile/src/stream.c'
+        'opusfile/src/stream.c',
+        'opusfile/src/x86pcm.c'
       ],
       'cflags': [
         '-pthread',
@@ -86,6 +93,11 @@
         'PIC',
         'HAVE_CONFIG_H'
       ],
+      'conditions': [
+        ['opusfile_fixed_point==1', {
+          'defines': [ 'OP_FIXED_POINT' ]
+        }]
+      ],
       'link_settings': {
         'ldflags': [
         ],
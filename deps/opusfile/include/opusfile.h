@@ -986,6 +986,25 @@ OP_WARN_UNUSED_RESULT void *op_freopen(OpusFileCallbacks *_cb,
 OP_WARN_UNUSED_RESULT void *op_mem_stream_create(OpusFileCallbacks *_cb,
  const unsigned char *_data,size_t _size) OP_ARG_NONNULL(1);
 
+/**Creates a stream that reads from a read-only memory mapping of a file.
+   The file is mapped whole, so reads involve no system calls, and
+    op_open_callbacks() parses pages directly from the mapping instead of
+    copying them through its ogg_sync_state.
+   Only regular, non-empty files can be mapped, and mapping is not
+    available on Windows.
+   \warning If another process truncates the file while it is mapped, reading
+    past the new end raises <code>SIGBUS</code> instead of failing with
+    #OP_EREAD.
+   Use op_fopen() for files that may change while they are being read.
+   \param[out] _cb   The callbacks to use for this stream.
+                     If there is an error creating the stream, nothing will be
+                      filled in here.
+   \param      _path The path to the file to map.
+   \return A stream handle to use with the callbacks, or <code>NULL</code> on
+            error.*/
+OP_WARN_UNUSED_RESULT void *op_mmap_stream_create(OpusFileCallbacks *_cb,
+ const char *_path) OP_ARG_NONNULL(1) OP_ARG_NONNULL(2);
+
 /**Creates a stream that reads from the given URL.
    This function behaves identically to op_url_stream_create(), except that it
     takes a va_list instead of a variable number of arguments.
@@ -1092,6 +1111,22 @@ int op_test(OpusHead *_head,
 OP_WARN_UNUSED_RESULT OggOpusFile *op_open_file(const char *_path,int *_error)
  OP_ARG_NONNULL(1);
 
+/**Open a stream from the given file path through a memory mapping.
+   This behaves like op_open_file(), but decodes and seeks from a mapping of
+    the file (see op_mmap_stream_create()).
+   Files that cannot be mapped are opened with stdio instead.
+   \warning As with op_mmap_stream_create(), truncating the file while it is
+    open raises <code>SIGBUS</code>; use op_open_file() for files that may
+    change underneath.
+   \param      _path  The path to the file to open.
+   \param[out] _error Returns 0 on success, or a failure code on error.
+                      You may pass in <code>NULL</code> if you don't want the
+                       failure code.
+                      See op_open_file() for a full list of failure codes.
+   \return A freshly opened \c OggOpusFile, or <code>NULL</code> on error.*/
+OP_WARN_UNUSED_RESULT OggOpusFile *op_open_mmap(const char *_path,int *_error)
+ OP_ARG_NONNULL(1);
+
 /**Open a stream from a memory buffer.
    \param      _data  The memory buffer to open.
    \param      _size  The number of bytes in the buffer.
@@ -1410,6 +1445,53 @@ OP_WARN_UNUSED_RESULT OggOpusFile *op_test_callbacks(void *_source,
                               validity checks.*/
 int op_test_open(OggOpusFile *_of) OP_ARG_NONNULL(1);
 
+/**Finish opening a stream partially opened with op_test_callbacks() or one of
+    the associated convenience functions, without enumerating its links.
+   For a seekable source, op_test_open() scans the end of the stream and
+    bisects it to find every link before it returns.
+   This function returns as soon as the first link is ready to decode, and
+    performs that scan the first time something needs it: op_link_count(),
+    op_pcm_total(), op_raw_total(), op_bitrate(), op_head(), op_tags() or
+    op_serialno() for a link other than the first, any seek, or decoding
+    reaching the end of the first link.
+   Playback continues from the same position after the scan.
+   If the scan fails, the rest of the source is decoded as though it were
+    unseekable, and the functions above fail as they would for an unseekable
+    source.
+   For unseekable sources, and for sources whose first link holds no audio,
+    this behaves exactly like op_test_open().
+   If this function fails, you are still responsible for freeing the
+    \c OggOpusFile with op_free().
+   \param _of The \c OggOpusFile to finish opening.
+   \return 0 on success, or a negative value on error.
+           See op_test_open() for a full list of failure codes.*/
+int op_test_open_lazy(OggOpusFile *_of) OP_ARG_NONNULL(1);
+
+/**Compute the duration of a partially opened, seekable, single-link stream
+    from its first and last pages.
+   op_test_callbacks() and its convenience functions have already read the
+    headers and the first audio page, which give the starting granule
+    position and pre-skip.
+   This function reads back from the end of the source to the last page of
+    that link for the ending granule position, and neither enumerates links
+    nor sets up a decoder.
+   The stream is left as it was, so it may still be finished with
+    op_test_open() or op_test_open_lazy().
+   \param _of The \c OggOpusFile to measure.
+   \return The duration in samples at 48 kHz, as op_pcm_total() would
+            return for a single-link stream, or a negative value on error.
+   \retval #OP_FALSE         The stream is chained, or its first link holds no
+                              audio.
+                             Finish opening it and use op_pcm_total()
+                              instead.
+   \retval #OP_EINVAL        The stream was not partially opened.
+   \retval #OP_ENOSEEK       The stream is not seekable.
+   \retval #OP_EREAD         An underlying read, seek, or tell operation failed.
+   \retval #OP_EBADLINK      No page of the stream could be found at its end.
+   \retval #OP_EBADTIMESTAMP The first or last timestamp failed basic validity
+                              checks.*/
+ogg_int64_t op_test_pcm_total(OggOpusFile *_of) OP_ARG_NONNULL(1);
+
 /**Release all memory used by an \c OggOpusFile.
    \param _of The \c OggOpusFile to free.*/
 void op_free(OggOpusFile *_of);
@@ -1698,6 +1780,51 @@ int op_raw_seek(OggOpusFile *_of,opus_int64 _byte_offset) OP_ARG_NONNULL(1);
                          seeking to the target destination was impossible.*/
 int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset) OP_ARG_NONNULL(1);
 
+/**Build an index from granule positions to page offsets for op_pcm_seek().
+   This reads the whole stream once.
+   Afterwards a seek narrows its search to the indexed pages around the
+    target and no longer bisects the file, so it costs one short read plus the
+    usual pre-roll.
+   The current playback position is preserved.
+   \param _of       The \c OggOpusFile to index.
+   \param _interval The minimum spacing between indexed pages, in samples at
+                     48 kHz, or 0 for the default of one second.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_EREAD    An underlying read or seek operation failed.
+   \retval #OP_EINVAL   The stream was only partially open.
+   \retval #OP_ENOSEEK  This stream is not seekable.
+   \retval #OP_EFAULT   An internal memory allocation failed.
+   \retval #OP_EBADLINK Returning to the original position failed.*/
+int op_seek_index_build(OggOpusFile *_of,opus_int32 _interval)
+ OP_ARG_NONNULL(1);
+
+/**Serialize the seek index, e.g., to store it next to the file.
+   \param      _of   The \c OggOpusFile whose index to save.
+   \param[out] _buf  The buffer to store the index in, or <code>NULL</code> to
+                      only query the size.
+   \param      _size The size of \a _buf.
+   \return The size of the serialized index, which is only written if it fits
+            in \a _buf, or a negative value on error.
+   \retval #OP_FALSE  There is no index.
+   \retval #OP_EINVAL The stream was only partially open.*/
+opus_int64 op_seek_index_save(const OggOpusFile *_of,
+ unsigned char *_buf,size_t _size) OP_ARG_NONNULL(1);
+
+/**Load a seek index saved by op_seek_index_save(), replacing any current one.
+   An index saved for a different file, or for this file before it was
+    changed, is rejected.
+   \param _of   The \c OggOpusFile to use the index with.
+   \param _data The serialized index.
+   \param _size The size of \a _data.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_EBADHEADER The data is not a valid seek index.
+   \retval #OP_EINVAL     The index does not match this stream, or the stream
+                           was only partially open.
+   \retval #OP_ENOSEEK    This stream is not seekable.
+   \retval #OP_EFAULT     An internal memory allocation failed.*/
+int op_seek_index_load(OggOpusFile *_of,const unsigned char *_data,
+ size_t _size) OP_ARG_NONNULL(1) OP_ARG_NONNULL(2);
+
 /*@}*/
 /*@}*/
 
@@ -1860,6 +1987,25 @@ int op_set_gain_offset(OggOpusFile *_of,
    \param _enabled A non-zero value to enable dithering, or 0 to disable it.*/
 void op_set_dither_enabled(OggOpusFile *_of,int _enabled) OP_ARG_NONNULL(1);
 
+/**Sets the sample rate to decode at.
+   By default, all output is at 48 kHz.
+   A lower rate lets <code>libopus</code> skip the upper bands of the
+    synthesis, which is cheaper than decoding at 48 kHz and resampling
+    afterwards.
+   Once set, the values returned by op_pcm_total() and op_pcm_tell(), the
+    offsets accepted by op_pcm_seek(), and the samples returned by the read
+    functions are all at the new rate.
+   Bitrates and the interval passed to op_seek_index_build() are still in
+    terms of 48 kHz samples.
+   This must be called before any samples have been read.
+   \param _of   The \c OggOpusFile on which to set the decode rate.
+   \param _rate The rate, in Hz: 8000, 12000, 16000, 24000, or 48000.
+   \return 0 on success or a negative value on error.
+   \retval #OP_EINVAL The \a _rate was unsupported, or samples have already
+                       been decoded at the old rate.
+   \retval #OP_EFAULT An internal memory allocation failed.*/
+int op_set_decode_rate(OggOpusFile *_of,opus_int32 _rate) OP_ARG_NONNULL(1);
+
 /**Reads more samples from the stream.
    \note Although \a _buf_size must indicate the total number of values that
     can be stored in \a _pcm, the return value is the number of samples
@@ -154,6 +154,22 @@ struct OggOpusLink{
   OpusTags     tags;
 };
 
+typedef struct OpusSeekEntry OpusSeekEntry;
+
+/*One page in a seek index (see op_seek_index_build()).*/
+struct OpusSeekEntry{
+  /*The granule position of the last packet completed on the page.*/
+  ogg_int64_t  gp;
+  /*The byte offset of the page.*/
+  opus_int64   offset;
+  /*The size of the page in bytes, so that offset+size is the next page.*/
+  opus_uint32  size;
+  /*The link the page belongs to.*/
+  int          li;
+  /*Whether the last packet on the page continues onto the next one.*/
+  int          continues;
+};
+
 struct OggOpusFile{
   /*The callbacks used to access the data source.*/
   OpusFileCallbacks  callbacks;
@@ -161,6 +177,12 @@ struct OggOpusFile{
   void              *source;
   /*Whether or not we can seek with this data source.*/
   int                seekable;
+  /*1 if this seekable source was opened with op_test_open_lazy() and the links
+     after the first have not been enumerated yet, a negative error code if
+     enumerating them failed, or 0 otherwise.
+    While this is non-zero, seekable is 0 and the source is read like a stream
+     positioned in the first link.*/
+  int                lazy_links;
   /*The number of links in this chained Ogg Opus file.*/
   int                nlinks;
   /*The cached information from each link in a chained Ogg Opus file.
@@ -185,6 +207,13 @@ struct OggOpusFile{
   opus_int64         end;
   /*Used to locate pages in the data source.*/
   ogg_sync_state     oy;
+  /*The whole data source when it is a block of memory or a mapped file, or
+     NULL.
+    Pages are then located and returned in place instead of being copied
+     through oy.*/
+  const unsigned char *map;
+  /*The size of map.*/
+  opus_int64         map_size;
   /*One of OP_NOTOPEN, OP_PARTOPEN, OP_OPENED, OP_STREAMSET, OP_INITSET.*/
   int                ready_state;
   /*The current link being played back.*/
@@ -198,6 +227,11 @@ struct OggOpusFile{
      when we use the current position as one of our bounds, only to later
      discover it was the correct starting point.*/
   opus_int64         prev_page_offset;
+  /*Granule position to page offset index used by op_pcm_seek(), in file
+     order, or NULL.*/
+  OpusSeekEntry     *seek_index;
+  /*The number of entries in seek_index.*/
+  int                nseek_index;
   /*The number of bytes read since the last bitrate query, including framing.*/
   opus_int64         bytes_tracked;
   /*The number of samples decoded since the last bitrate query.*/
@@ -233,6 +267,11 @@ struct OggOpusFile{
   int                od_buffer_pos;
   /*The number of valid samples in the decoded buffer.*/
   int                od_buffer_size;
+  /*The number of 48 kHz samples per decoded sample: 1, 2, 3, 4 or 6 (see
+     op_set_decode_rate()).
+    od_buffer_pos and od_buffer_size count decoded samples, while granule
+     positions, cur_discard_count and the links stay at 48 kHz.*/
+  int                rate_div;
   /*The type of gain offset to apply.
     One of OP_HEADER_GAIN, OP_ALBUM_GAIN, OP_TRACK_GAIN, or OP_ABSOLUTE_GAIN.*/
   int                gain_type;
@@ -258,4 +297,78 @@ struct OggOpusFile{
 
 int op_strncasecmp(const char *_a,const char *_b,int _n);
 
+/*If the stream was created by op_mem_stream_create() or
+   op_mmap_stream_create(), stores the block of memory it reads from and
+   returns 1; otherwise returns 0.*/
+int op_mem_stream_region(const OpusFileCallbacks *_cb,void *_stream,
+ const unsigned char **_data,opus_int64 *_size);
+
+#if !defined(OP_FIXED_POINT)
+/*Constants of the float->short dither (see op_float2short_filter()).
+  The vectorized kernels in x86pcm.c share them, since their output must be
+   bit-identical to the C code.*/
+# define OP_GAIN (32753.0F)
+
+# define OP_PRNG_GAIN (1.0F/0xFFFFFFFF)
+
+/*The LCG stepped by op_rand().*/
+# define OP_PRNG_MUL (96314165U)
+# define OP_PRNG_ADD (907633515U)
+
+/*48 kHz noise shaping filter, sd=2.34.*/
+
+static const float OP_FCOEF_B[4]={
+  2.2374F,-0.7339F,-0.1251F,-0.6033F
+};
+
+static const float OP_FCOEF_A[4]={
+  0.9030F,0.0116F,-0.5853F,-0.2571F
+};
+
+/*Quantizes _nsamples samples of _nchannels interleaved channels to 16 bits
+   with triangular dither and noise shaping.
+  _dither_a and _dither_b hold 4 taps of filter state per channel, and _seed
+   the PRNG state; both are updated.
+  Return: The updated count of consecutive silent samples, which stops the
+           dither (see op_float2short_filter()).*/
+typedef int (*op_dither_func)(opus_int16 *_dst,const float *_src,
+ int _nsamples,int _nchannels,float *_dither_a,float *_dither_b,
+ opus_uint32 *_seed,int _mute);
+
+/*Converts _n samples to 16 bits without dither, like
+   op_float2int(OP_CLAMP(-32768,32768.0F*_src[i],32767)).*/
+typedef void (*op_float2short_func)(opus_int16 *_dst,const float *_src,
+ int _n);
+#else
+/*Converts _n 16-bit samples to float, like (1.0F/32768)*_src[i].*/
+typedef void (*op_short2float_func)(float *_dst,const opus_int16 *_src,
+ int _n);
+
+/*Downmixes _nsamples samples of _nchannels channels (at least 3) to stereo
+   with a Q14 matrix, rounding and clamping like op_stereo_filter().
+  _dst may be the same as _src.*/
+typedef void (*op_downmix_short_func)(opus_int16 *_dst,const opus_int16 *_src,
+ int _nsamples,int _nchannels,const opus_int16 (*_matrix)[2]);
+#endif
+
+/*Downmixes _nsamples samples of _nchannels channels (at least 3) to stereo,
+   summing the channels in order.
+  _dst may be the same as _src.*/
+typedef void (*op_downmix_float_func)(float *_dst,const float *_src,
+ int _nsamples,int _nchannels,const float (*_matrix)[2]);
+
+/*The functions below return a vectorized kernel (see x86pcm.c) that this CPU
+   supports, or NULL to use the C loop.
+  Their output is identical to that of the C loops.
+  The environment variable OPUSFILE_SIMD may be set to "none", "sse2" or
+   "avx2" to cap the instruction set used, e.g. to compare the kernels.*/
+#if !defined(OP_FIXED_POINT)
+op_dither_func op_dither_select(int _nchannels);
+op_float2short_func op_float2short_select(void);
+#else
+op_short2float_func op_short2float_select(void);
+op_downmix_short_func op_downmix_short_select(int _nchannels);
+#endif
+op_downmix_float_func op_downmix_float_select(int _nchannels);
+
 #endif
@@ -174,6 +174,143 @@ static opus_int64 op_position(const OggOpusFile *_of){
   return _of->offset+_of->oy.fill-_of->oy.returned;
 }
 
+/*The Ogg page CRC: polynomial 0x04C11DB7, MSB first, initial value 0.*/
+static const ogg_uint32_t OP_CRC_TABLE[256]={
+  0x00000000,0x04C11DB7,0x09823B6E,0x0D4326D9,0x130476DC,0x17C56B6B,
+  0x1A864DB2,0x1E475005,0x2608EDB8,0x22C9F00F,0x2F8AD6D6,0x2B4BCB61,
+  0x350C9B64,0x31CD86D3,0x3C8EA00A,0x384FBDBD,0x4C11DB70,0x48D0C6C7,
+  0x4593E01E,0x4152FDA9,0x5F15ADAC,0x5BD4B01B,0x569796C2,0x52568B75,
+  0x6A1936C8,0x6ED82B7F,0x639B0DA6,0x675A1011,0x791D4014,0x7DDC5DA3,
+  0x709F7B7A,0x745E66CD,0x9823B6E0,0x9CE2AB57,0x91A18D8E,0x95609039,
+  0x8B27C03C,0x8FE6DD8B,0x82A5FB52,0x8664E6E5,0xBE2B5B58,0xBAEA46EF,
+  0xB7A96036,0xB3687D81,0xAD2F2D84,0xA9EE3033,0xA4AD16EA,0xA06C0B5D,
+  0xD4326D90,0xD0F37027,0xDDB056FE,0xD9714B49,0xC7361B4C,0xC3F706FB,
+  0xCEB42022,0xCA753D95,0xF23A8028,0xF6FB9D9F,0xFBB8BB46,0xFF79A6F1,
+  0xE13EF6F4,0xE5FFEB43,0xE8BCCD9A,0xEC7DD02D,0x34867077,0x30476DC0,
+  0x3D044B19,0x39C556AE,0x278206AB,0x23431B1C,0x2E003DC5,0x2AC12072,
+  0x128E9DCF,0x164F8078,0x1B0CA6A1,0x1FCDBB16,0x018AEB13,0x054BF6A4,
+  0x0808D07D,0x0CC9CDCA,0x7897AB07,0x7C56B6B0,0x71159069,0x75D48DDE,
+  0x6B93DDDB,0x6F52C06C,0x6211E6B5,0x66D0FB02,0x5E9F46BF,0x5A5E5B08,
+  0x571D7DD1,0x53DC6066,0x4D9B3063,0x495A2DD4,0x44190B0D,0x40D816BA,
+  0xACA5C697,0xA864DB20,0xA527FDF9,0xA1E6E04E,0xBFA1B04B,0xBB60ADFC,
+  0xB6238B25,0xB2E29692,0x8AAD2B2F,0x8E6C3698,0x832F1041,0x87EE0DF6,
+  0x99A95DF3,0x9D684044,0x902B669D,0x94EA7B2A,0xE0B41DE7,0xE4750050,
+  0xE9362689,0xEDF73B3E,0xF3B06B3B,0xF771768C,0xFA325055,0xFEF34DE2,
+  0xC6BCF05F,0xC27DEDE8,0xCF3ECB31,0xCBFFD686,0xD5B88683,0xD1799B34,
+  0xDC3ABDED,0xD8FBA05A,0x690CE0EE,0x6DCDFD59,0x608EDB80,0x644FC637,
+  0x7A089632,0x7EC98B85,0x738AAD5C,0x774BB0EB,0x4F040D56,0x4BC510E1,
+  0x46863638,0x42472B8F,0x5C007B8A,0x58C1663D,0x558240E4,0x51435D53,
+  0x251D3B9E,0x21DC2629,0x2C9F00F0,0x285E1D47,0x36194D42,0x32D850F5,
+  0x3F9B762C,0x3B5A6B9B,0x0315D626,0x07D4CB91,0x0A97ED48,0x0E56F0FF,
+  0x1011A0FA,0x14D0BD4D,0x19939B94,0x1D528623,0xF12F560E,0xF5EE4BB9,
+  0xF8AD6D60,0xFC6C70D7,0xE22B20D2,0xE6EA3D65,0xEBA91BBC,0xEF68060B,
+  0xD727BBB6,0xD3E6A601,0xDEA580D8,0xDA649D6F,0xC423CD6A,0xC0E2D0DD,
+  0xCDA1F604,0xC960EBB3,0xBD3E8D7E,0xB9FF90C9,0xB4BCB610,0xB07DABA7,
+  0xAE3AFBA2,0xAAFBE615,0xA7B8C0CC,0xA379DD7B,0x9B3660C6,0x9FF77D71,
+  0x92B45BA8,0x9675461F,0x8832161A,0x8CF30BAD,0x81B02D74,0x857130C3,
+  0x5D8A9099,0x594B8D2E,0x5408ABF7,0x50C9B640,0x4E8EE645,0x4A4FFBF2,
+  0x470CDD2B,0x43CDC09C,0x7B827D21,0x7F436096,0x7200464F,0x76C15BF8,
+  0x68860BFD,0x6C47164A,0x61043093,0x65C52D24,0x119B4BE9,0x155A565E,
+  0x18197087,0x1CD86D30,0x029F3D35,0x065E2082,0x0B1D065B,0x0FDC1BEC,
+  0x3793A651,0x3352BBE6,0x3E119D3F,0x3AD08088,0x2497D08D,0x2056CD3A,
+  0x2D15EBE3,0x29D4F654,0xC5A92679,0xC1683BCE,0xCC2B1D17,0xC8EA00A0,
+  0xD6AD50A5,0xD26C4D12,0xDF2F6BCB,0xDBEE767C,0xE3A1CBC1,0xE760D676,
+  0xEA23F0AF,0xEEE2ED18,0xF0A5BD1D,0xF464A0AA,0xF9278673,0xFDE69BC4,
+  0x89B8FD09,0x8D79E0BE,0x803AC667,0x84FBDBD0,0x9ABC8BD5,0x9E7D9662,
+  0x933EB0BB,0x97FFAD0C,0xAFB010B1,0xAB710D06,0xA6322BDF,0xA2F33668,
+  0xBCB4666D,0xB8757BDA,0xB5365D03,0xB1F740B4
+};
+
+static ogg_uint32_t op_crc_update(ogg_uint32_t _crc,
+ const unsigned char *_data,long _len){
+  long i;
+  for(i=0;i<_len;i++){
+    _crc=(_crc<<8)^OP_CRC_TABLE[((_crc>>24)&0xFF)^_data[i]];
+  }
+  return _crc;
+}
+
+/*op_get_next_page() for a source held entirely in memory (see
+   op_mem_stream_region()).
+  Pages are parsed where they lie and _og points into the mapping, so no data
+   is read or copied into the ogg_sync_state.
+  The CRC is checked with the checksum field taken as zero, as
+   ogg_sync_pageseek() does, without writing to the (read-only) mapping.*/
+static opus_int64 op_get_next_page_mapped(OggOpusFile *_of,ogg_page *_og,
+ opus_int64 _boundary){
+  const unsigned char *data;
+  opus_int64           size;
+  opus_int64           limit;
+  opus_int64           offset;
+  static const unsigned char ZEROS[4]={0,0,0,0};
+  data=_of->map;
+  size=_of->map_size;
+  /*With everything in memory there is no cached/uncached distinction, but a
+     caller passing 0 only wants a page that has already been read.*/
+  if(!_boundary)return OP_FALSE;
+  limit=_boundary<0?size:OP_MIN(_boundary,size);
+  offset=_of->offset;
+  while(offset<limit){
+    const unsigned char *page;
+    const unsigned char *found;
+    ogg_uint32_t         crc;
+    long                 header_len;
+    long                 body_len;
+    int                  nsegs;
+    int                  si;
+    found=(const unsigned char *)memchr(data+offset,'O',(size_t)(limit-offset));
+    if(found==NULL){
+      offset=limit;
+      break;
+    }
+    offset=found-data;
+    page=found;
+    /*The page must fit in the source, and before the boundary, if any.*/
+    if(size-offset<27){
+      if(memcmp(page,"OggS",(size_t)(size-offset))==0)break;
+      offset++;
+      continue;
+    }
+    if(memcmp(page,"OggS",4)!=0||page[4]!=0){
+      offset++;
+      continue;
+    }
+    nsegs=page[26];
+    header_len=27+nsegs;
+    if(size-offset<header_len)break;
+    body_len=0;
+    for(si=0;si<nsegs;si++)body_len+=page[27+si];
+    if(size-offset<header_len+body_len)break;
+    crc=op_crc_update(0,page,22);
+    crc=op_crc_update(crc,ZEROS,4);
+    crc=op_crc_update(crc,page+26,header_len-26);
+    crc=op_crc_update(crc,page+header_len,body_len);
+    if(crc!=(ogg_uint32_t)(page[22]|page[23]<<8|page[24]<<16
+     |(ogg_uint32_t)page[25]<<24)){
+      offset++;
+      continue;
+    }
+    if(offset+header_len+body_len>limit){
+      /*Like a page cut short by the boundary: leave it for the next call.*/
+      _of->offset=offset;
+      return OP_FALSE;
+    }
+    _og->header=(unsigned char *)page;
+    _og->header_len=header_len;
+    _og->body=(unsigned char *)page+header_len;
+    _og->body_len=body_len;
+    _of->offset=offset+header_len+body_len;
+    /*Keep the stream position in step with op_position().*/
+    (*_of->callbacks.seek)(_of->source,_of->offset,SEEK_SET);
+    return offset;
+  }
+  /*Ran out of data: either the source ended, or the page starting at offset
+     is cut short by it.*/
+  _of->offset=offset;
+  if(_boundary>0&&offset<_boundary)return OP_EBADLINK;
+  return OP_FALSE;
+}
+
 /*From the head of the stream, get the next page.
   _boundary specifies if the function is allowed to fetch more data from the
    stream (and how much) or only use internally buffered data.
@@ -187,6 +324,7 @@ static opus_int64 op_position(const OggOpusFile *_of){
           OP_BADLINK: We hit end-of-file before reaching _boundary.*/
 static opus_int64 op_get_next_page(OggOpusFile *_of,ogg_page *_og,
  opus_int64 _boundary){
+  if(_of->map!=NULL)return op_get_next_page_mapped(_of,_og,_boundary);
   while(_boundary<=0||_of->offset<_boundary){
     int more;
     more=ogg_sync_pageseek(&_of->oy,_og);
@@ -1366,8 +1504,8 @@ static int op_make_decode_ready(OggOpusFile *_of){
   else{
     int err;
     opus_multistream_decoder_destroy(_of->od);
-    _of->od=opus_multistream_decoder_create(48000,channel_count,
-     stream_count,coupled_count,head->mapping,&err);
+    _of->od=opus_multistream_decoder_create(48000/_of->rate_div,
+     channel_count,stream_count,coupled_count,head->mapping,&err);
     if(_of->od==NULL)return OP_EFAULT;
     _of->od_stream_count=stream_count;
     _of->od_coupled_count=coupled_count;
@@ -1387,7 +1525,11 @@ static int op_make_decode_ready(OggOpusFile *_of){
   return 0;
 }
 
-static int op_open_seekable2_impl(OggOpusFile *_of){
+/*Enumerate the links of a seekable stream or, if _duration is not NULL,
+   only measure the first one.
+  The latter reads nothing but the end of the stream, and fails with OP_FALSE
+   if the last page there is not from the first link.*/
+static int op_open_seekable2_impl(OggOpusFile *_of,ogg_int64_t *_duration){
   /*64 seek records should be enough for anybody.
     Actually, with a bisection search in a 63-bit range down to OP_CHUNK_SIZE
      granularity, much more than enough.*/
@@ -1409,12 +1551,23 @@ static int op_open_seekable2_impl(OggOpusFile *_of){
   /*If there's any trailing junk, forget about it.*/
   _of->end=sr[0].offset+sr[0].size;
   if(OP_UNLIKELY(_of->end<data_offset))return OP_EBADLINK;
+  if(_duration!=NULL){
+    OggOpusLink link;
+    if(!op_lookup_serialno(sr[0].serialno,_of->serialnos,_of->nserialnos)){
+      return OP_FALSE;
+    }
+    /*Work on a copy, so the partially open stream is left as it was.*/
+    *&link=*_of->links;
+    *_duration=0;
+    return op_find_final_pcm_offset(_of,_of->serialnos,_of->nserialnos,&link,
+     sr[0].offset,sr[0].serialno,sr[0].gp,_duration);
+  }
   /*Now enumerate the bitstream structure.*/
   return op_bisect_forward_serialno(_of,data_offset,sr,sizeof(sr)/sizeof(*sr),
    &_of->serialnos,&_of->nserialnos,&_of->cserialnos);
 }
 
-static int op_open_seekable2(OggOpusFile *_of){
+static int op_open_seekable2(OggOpusFile *_of,ogg_int64_t *_duration){
   ogg_sync_state    oy_start;
   ogg_stream_state  os_start;
   ogg_packet       *op_start;
@@ -1444,7 +1597,7 @@ static int op_open_seekable2(OggOpusFile *_of){
   OP_ASSERT((*_of->callbacks.tell)(_of->source)==op_position(_of));
   ogg_sync_init(&_of->oy);
   ogg_stream_init(&_of->os,-1);
-  ret=op_open_seekable2_impl(_of);
+  ret=op_open_seekable2_impl(_of,_duration);
   /*Restore the old stream state.*/
   ogg_stream_clear(&_of->os);
   ogg_sync_clear(&_of->oy);
@@ -1463,6 +1616,55 @@ static int op_open_seekable2(OggOpusFile *_of){
   return OP_UNLIKELY(ret<0)?OP_EREAD:0;
 }
 
+/*Enumerate the links of a stream opened with op_test_open_lazy().
+  Until this runs, the stream is read as if it were unseekable, which is only
+   valid inside the first link, so this must happen before decoding crosses
+   into a second one.
+  op_open_seekable2() already brings the stream back to exactly where it was;
+   we additionally keep the decoder's place in the first link, so playback
+   continues without a seek.
+  Return: 0 on success, or a negative value on error.
+          The error is remembered and returned again on later calls.*/
+static int op_resolve_links(OggOpusFile *_of){
+  ogg_int64_t prev_packet_gp;
+  opus_int32  cur_discard_count;
+  int         ready_state;
+  int         ret;
+  if(OP_LIKELY(_of->lazy_links<=0))return _of->lazy_links;
+  OP_ASSERT(!_of->seekable);
+  OP_ASSERT(_of->ready_state>=OP_STREAMSET);
+  prev_packet_gp=_of->prev_packet_gp;
+  cur_discard_count=_of->cur_discard_count;
+  ready_state=_of->ready_state;
+  _of->seekable=1;
+  _of->ready_state=OP_OPENED;
+  ret=op_open_seekable2(_of,NULL);
+  _of->ready_state=ready_state;
+  _of->prev_packet_gp=prev_packet_gp;
+  _of->cur_discard_count=cur_discard_count;
+  if(OP_UNLIKELY(ret<0)){
+    int li;
+    /*Fall back to reading the rest of the source as a stream.*/
+    for(li=1;li<_of->nlinks;li++)opus_tags_clear(&_of->links[li].tags);
+    _of->nlinks=1;
+    _of->seekable=0;
+    _of->end=-1;
+    _of->lazy_links=ret;
+    return ret;
+  }
+  _of->cur_link=0;
+  _of->lazy_links=0;
+  return 0;
+}
+
+/*Make sure the link table is complete before answering a query about it.
+  The query functions take a const pointer, but the handle they are given
+   never is, so finishing a lazy open behind them is safe.*/
+static int op_links_ready(const OggOpusFile *_of){
+  if(OP_LIKELY(_of->lazy_links<=0))return _of->lazy_links;
+  return op_resolve_links((OggOpusFile *)_of);
+}
+
 /*Clear out the current logical bitstream decoder.*/
 static void op_decode_clear(OggOpusFile *_of){
   /*We don't actually free the decoder.
@@ -1496,6 +1698,7 @@ static void op_clear(OggOpusFile *_of){
   }
   _ogg_free(links);
   _ogg_free(_of->serialnos);
+  _ogg_free(_of->seek_index);
   ogg_stream_clear(&_of->os);
   ogg_sync_clear(&_of->oy);
   if(_of->callbacks.close!=NULL)(*_of->callbacks.close)(_of->source);
@@ -1511,6 +1714,7 @@ static int op_open1(OggOpusFile *_of,
   memset(_of,0,sizeof(*_of));
   if(OP_UNLIKELY(_initial_bytes>(size_t)LONG_MAX))return OP_EFAULT;
   _of->end=-1;
+  _of->rate_div=1;
   _of->source=_source;
   *&_of->callbacks=*_cb;
   /*At a minimum, we need to be able to read data.*/
@@ -1543,6 +1747,11 @@ static int op_open1(OggOpusFile *_of,
     if(OP_UNLIKELY(pos!=(opus_int64)_initial_bytes))return OP_EINVAL;
   }
   _of->seekable=seekable;
+  /*A source that is already in memory can be parsed in place, as long as
+     there is no initial data sitting in oy ahead of it.*/
+  if(seekable&&_initial_bytes==0){
+    op_mem_stream_region(_cb,_source,&_of->map,&_of->map_size);
+  }
   /*Don't seek yet.
     Set up a 'single' (current) logical bitstream entry for partial open.*/
   _of->links=(OggOpusLink *)_ogg_malloc(sizeof(*_of->links));
@@ -1575,12 +1784,20 @@ static int op_open1(OggOpusFile *_of,
   return ret;
 }
 
-static int op_open2(OggOpusFile *_of){
+static int op_open2(OggOpusFile *_of,int _lazy){
   int ret;
   OP_ASSERT(_of->ready_state==OP_PARTOPEN);
-  if(_of->seekable){
+  /*A lazy open needs buffered packets from the first link to start decoding
+     from.
+    If that link was empty, enumerate everything now.*/
+  if(_lazy&&_of->seekable&&_of->op_count>0){
+    _of->seekable=0;
+    _of->lazy_links=1;
+    ret=0;
+  }
+  else if(_of->seekable){
     _of->ready_state=OP_OPENED;
-    ret=op_open_seekable2(_of);
+    ret=op_open_seekable2(_of,NULL);
   }
   else ret=0;
   if(OP_LIKELY(ret>=0)){
@@ -1623,7 +1840,7 @@ OggOpusFile *op_open_callbacks(void *_source,const OpusFileCallbacks *_cb,
   of=op_test_callbacks(_source,_cb,_initial_data,_initial_bytes,_error);
   if(OP_LIKELY(of!=NULL)){
     int ret;
-    ret=op_open2(of);
+    ret=op_open2(of,0);
     if(OP_LIKELY(ret>=0))return of;
     if(_error!=NULL)*_error=ret;
     _ogg_free(of);
@@ -1657,6 +1874,15 @@ OggOpusFile *op_open_memory(const unsigned char *_data,size_t _size,
    _error);
 }
 
+OggOpusFile *op_open_mmap(const char *_path,int *_error){
+  OpusFileCallbacks  cb;
+  void              *source;
+  source=op_mmap_stream_create(&cb,_path);
+  /*Fall back to stdio for whatever cannot be mapped.*/
+  if(source==NULL)source=op_fopen(&cb,_path,"rb");
+  return op_open_close_on_failure(source,&cb,_error);
+}
+
 /*Convenience routine to clean up from failure for the open functions that
    create their own streams.*/
 static OggOpusFile *op_test_close_on_failure(void *_source,
@@ -1683,16 +1909,42 @@ OggOpusFile *op_test_memory(const unsigned char *_data,size_t _size,
    _error);
 }
 
-int op_test_open(OggOpusFile *_of){
+static int op_test_open_impl(OggOpusFile *_of,int _lazy){
   int ret;
   if(OP_UNLIKELY(_of->ready_state!=OP_PARTOPEN))return OP_EINVAL;
-  ret=op_open2(_of);
+  ret=op_open2(_of,_lazy);
   /*op_open2() will clear this structure on failure.
     Reset its contents to prevent double-frees in op_free().*/
   if(OP_UNLIKELY(ret<0))memset(_of,0,sizeof(*_of));
   return ret;
 }
 
+int op_test_open(OggOpusFile *_of){
+  return op_test_open_impl(_of,0);
+}
+
+int op_test_open_lazy(OggOpusFile *_of){
+  return op_test_open_impl(_of,1);
+}
+
+ogg_int64_t op_test_pcm_total(OggOpusFile *_of){
+  ogg_int64_t duration;
+  opus_int64  end;
+  int         ret;
+  if(OP_UNLIKELY(_of->ready_state!=OP_PARTOPEN))return OP_EINVAL;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  /*An empty first link is always followed by another one.*/
+  if(_of->op_count<=0)return OP_FALSE;
+  /*op_open_seekable2() brings the stream back to where it was, so the caller
+     can still finish opening it.*/
+  end=_of->end;
+  _of->ready_state=OP_OPENED;
+  ret=op_open_seekable2(_of,&duration);
+  _of->ready_state=OP_PARTOPEN;
+  _of->end=end;
+  return OP_UNLIKELY(ret<0)?ret:duration;
+}
+
 void op_free(OggOpusFile *_of){
   if(OP_LIKELY(_of!=NULL)){
     op_clear(_of);
@@ -1701,14 +1953,16 @@ void op_free(OggOpusFile *_of){
 }
 
 int op_seekable(const OggOpusFile *_of){
-  return _of->seekable;
+  return _of->seekable||_of->lazy_links!=0;
 }
 
 int op_link_count(const OggOpusFile *_of){
+  op_links_ready(_of);
   return _of->nlinks;
 }
 
 opus_uint32 op_serialno(const OggOpusFile *_of,int _li){
+  if(_li>0)op_links_ready(_of);
   if(OP_UNLIKELY(_li>=_of->nlinks))_li=_of->nlinks-1;
   if(!_of->seekable)_li=0;
   return _of->links[_li<0?_of->cur_link:_li].serialno;
@@ -1719,7 +1973,8 @@ int op_channel_count(const OggOpusFile *_of,int _li){
 }
 
 opus_int64 op_raw_total(const OggOpusFile *_of,int _li){
-  if(OP_UNLIKELY(_of->ready_state<OP_OPENED)
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(op_links_ready(_of)<0)
    ||OP_UNLIKELY(!_of->seekable)
    ||OP_UNLIKELY(_li>=_of->nlinks)){
     return OP_EINVAL;
@@ -1729,14 +1984,16 @@ opus_int64 op_raw_total(const OggOpusFile *_of,int _li){
    -(_li>0?_of->links[_li].offset:0);
 }
 
-ogg_int64_t op_pcm_total(const OggOpusFile *_of,int _li){
+/*The body of op_pcm_total(), counting samples at 48 kHz.*/
+static ogg_int64_t op_pcm_total_48k(const OggOpusFile *_of,int _li){
   OggOpusLink *links;
   ogg_int64_t  pcm_total;
   ogg_int64_t  diff;
   int          nlinks;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(op_links_ready(_of)<0))return OP_EINVAL;
   nlinks=_of->nlinks;
-  if(OP_UNLIKELY(_of->ready_state<OP_OPENED)
-   ||OP_UNLIKELY(!_of->seekable)
+  if(OP_UNLIKELY(!_of->seekable)
    ||OP_UNLIKELY(_li>=nlinks)){
     return OP_EINVAL;
   }
@@ -1754,13 +2011,85 @@ ogg_int64_t op_pcm_total(const OggOpusFile *_of,int _li){
   return pcm_total+diff-links[_li].head.pre_skip;
 }
 
+/*Convert a count of 48 kHz samples from the start of a link's output to the
+   number of samples the decoder produces for them at the decode rate.
+  The decoder keeps every rate_div'th sample counting from the start of the
+   link, so this counts those that land past the pre-skip.*/
+static ogg_int64_t op_rate_from_48k_link(const OggOpusFile *_of,int _li,
+ ogg_int64_t _nsamples){
+  ogg_int64_t pre_skip;
+  int         rate_div;
+  rate_div=_of->rate_div;
+  pre_skip=_of->links[_li].head.pre_skip;
+  return (pre_skip+_nsamples+rate_div-1)/rate_div
+   -(pre_skip+rate_div-1)/rate_div;
+}
+
+/*Convert a PCM offset at 48 kHz to one at the decode rate.*/
+static ogg_int64_t op_rate_from_48k(const OggOpusFile *_of,
+ ogg_int64_t _pcm_offset){
+  const OggOpusLink *links;
+  ogg_int64_t        ret;
+  int                nlinks;
+  int                li;
+  if(OP_LIKELY(_of->rate_div<=1)||OP_UNLIKELY(_pcm_offset<0)
+   ||OP_UNLIKELY(_pcm_offset==OP_INT64_MAX)){
+    return _pcm_offset;
+  }
+  links=_of->links;
+  nlinks=_of->seekable?_of->nlinks:1;
+  ret=0;
+  for(li=0;li+1<nlinks&&links[li+1].pcm_file_offset<=_pcm_offset;li++){
+    ret+=op_rate_from_48k_link(_of,li,
+     links[li+1].pcm_file_offset-links[li].pcm_file_offset);
+  }
+  return ret+op_rate_from_48k_link(_of,li,
+   _pcm_offset-links[li].pcm_file_offset);
+}
+
+/*Convert a PCM offset at the decode rate to the 48 kHz offset of the same
+   sample.
+  Offsets past the end map past the end of the last link.*/
+static ogg_int64_t op_rate_to_48k(const OggOpusFile *_of,
+ ogg_int64_t _pcm_offset){
+  const OggOpusLink *links;
+  ogg_int64_t        pre_skip;
+  int                rate_div;
+  int                nlinks;
+  int                li;
+  rate_div=_of->rate_div;
+  if(OP_LIKELY(rate_div<=1))return _pcm_offset;
+  links=_of->links;
+  nlinks=_of->nlinks;
+  for(li=0;li+1<nlinks;li++){
+    ogg_int64_t link_total;
+    link_total=op_rate_from_48k_link(_of,li,
+     links[li+1].pcm_file_offset-links[li].pcm_file_offset);
+    if(_pcm_offset<link_total)break;
+    _pcm_offset-=link_total;
+  }
+  pre_skip=links[li].head.pre_skip;
+  return links[li].pcm_file_offset
+   +((pre_skip+rate_div-1)/rate_div+_pcm_offset)*rate_div-pre_skip;
+}
+
+ogg_int64_t op_pcm_total(const OggOpusFile *_of,int _li){
+  ogg_int64_t pcm_total;
+  pcm_total=op_pcm_total_48k(_of,_li);
+  if(OP_LIKELY(_of->rate_div<=1)||OP_UNLIKELY(pcm_total<0))return pcm_total;
+  if(_li<0)return op_rate_from_48k(_of,pcm_total);
+  return op_rate_from_48k_link(_of,_li,pcm_total);
+}
+
 const OpusHead *op_head(const OggOpusFile *_of,int _li){
+  if(_li>0)op_links_ready(_of);
   if(OP_UNLIKELY(_li>=_of->nlinks))_li=_of->nlinks-1;
   if(!_of->seekable)_li=0;
   return &_of->links[_li<0?_of->cur_link:_li].head;
 }
 
 const OpusTags *op_tags(const OggOpusFile *_of,int _li){
+  if(_li>0)op_links_ready(_of);
   if(OP_UNLIKELY(_li>=_of->nlinks))_li=_of->nlinks-1;
   if(!_of->seekable){
     if(_of->ready_state<OP_STREAMSET&&_of->ready_state!=OP_PARTOPEN){
@@ -1802,11 +2131,12 @@ static opus_int32 op_calc_bitrate(opus_int64 _bytes,ogg_int64_t _samples){
 }
 
 opus_int32 op_bitrate(const OggOpusFile *_of,int _li){
-  if(OP_UNLIKELY(_of->ready_state<OP_OPENED)||OP_UNLIKELY(!_of->seekable)
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(op_links_ready(_of)<0)||OP_UNLIKELY(!_of->seekable)
    ||OP_UNLIKELY(_li>=_of->nlinks)){
     return OP_EINVAL;
   }
-  return op_calc_bitrate(op_raw_total(_of,_li),op_pcm_total(_of,_li));
+  return op_calc_bitrate(op_raw_total(_of,_li),op_pcm_total_48k(_of,_li));
 }
 
 opus_int32 op_bitrate_instant(OggOpusFile *_of){
@@ -1889,6 +2219,13 @@ static int op_fetch_and_process_page(OggOpusFile *_of,
       if(OP_LIKELY(!ogg_page_bos(&og)))continue;
       /* 2) Our decoding just traversed a bitstream boundary.*/
       if(!_spanp)return OP_EOF;
+      /*A lazily opened source has to know its links before it leaves the
+         first one.
+        If we can't enumerate them, carry on as a stream.*/
+      if(OP_UNLIKELY(_of->lazy_links>0)&&op_resolve_links(_of)>=0){
+        seekable=1;
+        links=_of->links;
+      }
       if(OP_LIKELY(_of->ready_state>=OP_INITSET))op_decode_clear(_of);
     }
     /*Bitrate tracking: add the header's bytes here.
@@ -2147,6 +2484,8 @@ int op_raw_seek(OggOpusFile *_of,opus_int64 _pos){
   int ret;
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
   /*Don't dump the decoder state if we can't seek.*/
+  ret=op_resolve_links(_of);
+  if(OP_UNLIKELY(ret<0))return ret;
   if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
   if(OP_UNLIKELY(_pos<0)||OP_UNLIKELY(_pos>_of->end))return OP_EINVAL;
   /*Clear out any buffered, decoded data.*/
@@ -2234,6 +2573,81 @@ static void op_buffer_continued_data(OggOpusFile *_of,ogg_page *_og){
   while(ogg_stream_packetout(&_of->os,&op));
 }
 
+/*Narrows the bisection interval of op_pcm_seek_page() with the seek index.
+  [*_begin,*_end) is the range of link _li still to search, bounded by the
+   granule positions *_pcm_start and *_pcm_end.
+  On return *_begin is the end of the last indexed page before _target_gp and
+   *_end the end of the first one at or after it, so that, with an index entry
+   every second or so, the search becomes a single short forward scan.
+  Return: 1 if *_begin moved (with *_best_start set as op_pcm_seek_page()
+           expects), 0 otherwise.*/
+static int op_seek_index_narrow(const OggOpusFile *_of,int _li,
+ ogg_int64_t _target_gp,opus_int64 *_begin,opus_int64 *_end,
+ ogg_int64_t *_pcm_start,ogg_int64_t *_pcm_end,opus_int64 *_best_start){
+  const OggOpusLink   *link;
+  const OpusSeekEntry *index;
+  int                  lo;
+  int                  hi;
+  int                  first;
+  int                  last;
+  int                  moved;
+  index=_of->seek_index;
+  if(index==NULL)return 0;
+  link=_of->links+_li;
+  /*Find the entries for this link.*/
+  lo=0;
+  hi=_of->nseek_index;
+  while(lo<hi){
+    int mid;
+    mid=lo+(hi-lo>>1);
+    if(index[mid].li<_li)lo=mid+1;
+    else hi=mid;
+  }
+  first=lo;
+  hi=_of->nseek_index;
+  while(lo<hi){
+    int mid;
+    mid=lo+(hi-lo>>1);
+    if(index[mid].li<=_li)lo=mid+1;
+    else hi=mid;
+  }
+  last=lo;
+  /*Then the first one at or after the target.*/
+  lo=first;
+  hi=last;
+  while(lo<hi){
+    int mid;
+    mid=lo+(hi-lo>>1);
+    if(op_granpos_cmp(index[mid].gp,_target_gp)<0)lo=mid+1;
+    else hi=mid;
+  }
+  moved=0;
+  if(lo>first){
+    const OpusSeekEntry *e;
+    opus_int64           next;
+    e=index+lo-1;
+    next=e->offset+e->size;
+    if(next>*_begin&&next<=*_end&&op_granpos_cmp(e->gp,*_pcm_start)>=0){
+      *_begin=next;
+      *_pcm_start=e->gp;
+      *_best_start=e->continues?e->offset:next;
+      moved=1;
+    }
+  }
+  if(lo<last){
+    const OpusSeekEntry *e;
+    opus_int64           next;
+    e=index+lo;
+    next=e->offset+e->size;
+    if(e->offset<link->end_offset&&next<*_end&&next>=*_begin
+     &&op_granpos_cmp(e->gp,*_pcm_end)<=0){
+      *_end=next;
+      *_pcm_end=e->gp;
+    }
+  }
+  return moved;
+}
+
 /*This controls how close the target has to be to use the current stream
    position to subdivide the initial range.
   Two minutes seems to be a good default.*/
@@ -2373,6 +2787,15 @@ static int op_pcm_seek_page(OggOpusFile *_of,
       }
     }
 #endif
+    /*A seek index can narrow the range to a page or two.*/
+    if(op_seek_index_narrow(_of,_li,_target_gp,&begin,&end,
+     &pcm_start,&pcm_end,&best_start)){
+      best=begin;
+      best_gp=pcm_start;
+      /*Whatever the current position had buffered no longer applies.*/
+      buffering=0;
+    }
+    boundary=end;
   }
   /*This code was originally based on the "new search algorithm by HB (Nicholas
      Vinen)" from libvorbisfile.
@@ -2570,7 +2993,8 @@ static int op_pcm_seek_page(OggOpusFile *_of,
   return 0;
 }
 
-int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
+/*The body of op_pcm_seek(), taking an offset at 48 kHz.*/
+static int op_pcm_seek_48k(OggOpusFile *_of,ogg_int64_t _pcm_offset){
   const OggOpusLink *link;
   ogg_int64_t        pcm_start;
   ogg_int64_t        target_gp;
@@ -2582,6 +3006,8 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
   int                ret;
   int                li;
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  ret=op_resolve_links(_of);
+  if(OP_UNLIKELY(ret<0))return ret;
   if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
   if(OP_UNLIKELY(_pcm_offset<0))return OP_EINVAL;
   target_gp=op_get_granulepos(_of,_pcm_offset,&li);
@@ -2599,7 +3025,7 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
     if(OP_LIKELY(gp!=-1)){
       int nbuffered;
       nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0);
-      OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered));
+      OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered*_of->rate_div));
       /*We do _not_ add cur_discard_count to gp.
         Otherwise the total amount to discard could grow without bound, and it
          would be better just to do a full seek.*/
@@ -2659,6 +3085,225 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
   return 0;
 }
 
+int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
+  int ret;
+  if(OP_LIKELY(_of->rate_div<=1))return op_pcm_seek_48k(_of,_pcm_offset);
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  ret=op_resolve_links(_of);
+  if(OP_UNLIKELY(ret<0))return ret;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  if(OP_UNLIKELY(_pcm_offset<0))return OP_EINVAL;
+  return op_pcm_seek_48k(_of,op_rate_to_48k(_of,_pcm_offset));
+}
+
+/*The serialized seek index: a header, the serial number of every link, and
+   then one entry per indexed page, all little-endian.*/
+#define OP_SEEK_INDEX_MAGIC "OpusSkIx"
+#define OP_SEEK_INDEX_HEADER_SIZE (8+4+8+4+4)
+#define OP_SEEK_INDEX_ENTRY_SIZE (8+8+4+4)
+
+static void op_put_le32(unsigned char *_p,opus_uint32 _v){
+  _p[0]=(unsigned char)(_v&0xFF);
+  _p[1]=(unsigned char)(_v>>8&0xFF);
+  _p[2]=(unsigned char)(_v>>16&0xFF);
+  _p[3]=(unsigned char)(_v>>24&0xFF);
+}
+
+static void op_put_le64(unsigned char *_p,ogg_int64_t _v){
+  op_put_le32(_p,(opus_uint32)((opus_uint64)_v&0xFFFFFFFF));
+  op_put_le32(_p+4,(opus_uint32)((opus_uint64)_v>>32));
+}
+
+static opus_uint32 op_get_le32(const unsigned char *_p){
+  return _p[0]|_p[1]<<8|_p[2]<<16|(opus_uint32)_p[3]<<24;
+}
+
+static ogg_int64_t op_get_le64(const unsigned char *_p){
+  return (ogg_int64_t)(op_get_le32(_p)|(opus_uint64)op_get_le32(_p+4)<<32);
+}
+
+int op_seek_index_build(OggOpusFile *_of,opus_int32 _interval){
+  OpusSeekEntry *index;
+  ogg_int64_t    pcm_offset;
+  int            nindex;
+  int            cindex;
+  int            nlinks;
+  int            li;
+  int            ret;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  ret=op_resolve_links(_of);
+  if(OP_UNLIKELY(ret<0))return ret;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  if(_interval<=0)_interval=48000;
+  pcm_offset=op_pcm_tell(_of);
+  /*The scan below moves the stream, so drop the decoder state now and seek
+     back afterwards.*/
+  op_decode_clear(_of);
+  index=NULL;
+  nindex=cindex=0;
+  nlinks=_of->nlinks;
+  ret=0;
+  for(li=0;li<nlinks&&ret>=0;li++){
+    const OggOpusLink *link;
+    opus_int64         boundary;
+    ogg_int64_t        last_gp;
+    int                have_gp;
+    link=_of->links+li;
+    boundary=li+1<nlinks?_of->links[li+1].offset:_of->end;
+    ret=op_seek_helper(_of,link->data_offset);
+    last_gp=-1;
+    have_gp=0;
+    while(ret>=0){
+      ogg_page    og;
+      opus_int64  page_offset;
+      ogg_int64_t gp;
+      ogg_int64_t diff;
+      page_offset=op_get_next_page(_of,&og,boundary);
+      if(page_offset<0){
+        if(page_offset<OP_FALSE)ret=(int)page_offset;
+        break;
+      }
+      if((ogg_uint32_t)ogg_page_serialno(&og)!=link->serialno
+       ||ogg_page_packets(&og)<=0){
+        continue;
+      }
+      gp=ogg_page_granulepos(&og);
+      if(gp==-1)continue;
+      /*Keep the first page of each link and then one page per interval.*/
+      if(have_gp&&!op_granpos_diff(&diff,gp,last_gp)&&diff<_interval){
+        continue;
+      }
+      if(nindex>=cindex){
+        OpusSeekEntry *grown;
+        cindex=cindex?cindex<<1:64;
+        grown=(OpusSeekEntry *)_ogg_realloc(index,sizeof(*index)*cindex);
+        if(OP_UNLIKELY(grown==NULL)){
+          ret=OP_EFAULT;
+          break;
+        }
+        index=grown;
+      }
+      index[nindex].gp=gp;
+      index[nindex].offset=page_offset;
+      index[nindex].size=(opus_uint32)(_of->offset-page_offset);
+      index[nindex].li=li;
+      index[nindex].continues=op_page_continues(&og);
+      nindex++;
+      last_gp=gp;
+      have_gp=1;
+    }
+  }
+  if(ret>=0){
+    _ogg_free(_of->seek_index);
+    _of->seek_index=index;
+    _of->nseek_index=nindex;
+  }
+  else _ogg_free(index);
+  /*Put the decoder back where it was.*/
+  if(op_pcm_seek(_of,pcm_offset<0?0:pcm_offset)<0&&ret>=0)ret=OP_EBADLINK;
+  return ret<0?ret:0;
+}
+
+opus_int64 op_seek_index_save(const OggOpusFile *_of,
+ unsigned char *_buf,size_t _size){
+  opus_int64 needed;
+  int        nlinks;
+  int        li;
+  int        ei;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(_of->seek_index==NULL)return OP_FALSE;
+  nlinks=_of->nlinks;
+  needed=OP_SEEK_INDEX_HEADER_SIZE+4*(opus_int64)nlinks
+   +OP_SEEK_INDEX_ENTRY_SIZE*(opus_int64)_of->nseek_index;
+  if(_buf==NULL||(opus_int64)_size<needed)return needed;
+  memcpy(_buf,OP_SEEK_INDEX_MAGIC,8);
+  op_put_le32(_buf+8,1);
+  op_put_le64(_buf+12,_of->end);
+  op_put_le32(_buf+20,(opus_uint32)nlinks);
+  op_put_le32(_buf+24,(opus_uint32)_of->nseek_index);
+  _buf+=OP_SEEK_INDEX_HEADER_SIZE;
+  for(li=0;li<nlinks;li++){
+    op_put_le32(_buf,_of->links[li].serialno);
+    _buf+=4;
+  }
+  for(ei=0;ei<_of->nseek_index;ei++){
+    const OpusSeekEntry *e;
+    e=_of->seek_index+ei;
+    op_put_le64(_buf,e->gp);
+    op_put_le64(_buf+8,e->offset);
+    op_put_le32(_buf+16,e->size);
+    op_put_le32(_buf+20,(opus_uint32)e->li<<1|(e->continues?1:0));
+    _buf+=OP_SEEK_INDEX_ENTRY_SIZE;
+  }
+  return needed;
+}
+
+int op_seek_index_load(OggOpusFile *_of,const unsigned char *_data,
+ size_t _size){
+  OpusSeekEntry *index;
+  opus_uint32    nlinks;
+  opus_uint32    nindex;
+  opus_uint32    ei;
+  int            li;
+  int            ret;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  ret=op_resolve_links(_of);
+  if(OP_UNLIKELY(ret<0))return ret;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  if(_size<OP_SEEK_INDEX_HEADER_SIZE||memcmp(_data,OP_SEEK_INDEX_MAGIC,8)!=0
+   ||op_get_le32(_data+8)!=1){
+    return OP_EBADHEADER;
+  }
+  nlinks=op_get_le32(_data+20);
+  nindex=op_get_le32(_data+24);
+  if((opus_uint64)_size!=OP_SEEK_INDEX_HEADER_SIZE+4*(opus_uint64)nlinks
+   +OP_SEEK_INDEX_ENTRY_SIZE*(opus_uint64)nindex
+   ||nindex>(opus_uint32)(INT_MAX/sizeof(*index))){
+    return OP_EBADHEADER;
+  }
+  /*An index made for another file, or before this one changed, is refused.*/
+  if(op_get_le64(_data+12)!=_of->end||nlinks!=(opus_uint32)_of->nlinks){
+    return OP_EINVAL;
+  }
+  _data+=OP_SEEK_INDEX_HEADER_SIZE;
+  for(li=0;li<_of->nlinks;li++){
+    if(op_get_le32(_data)!=_of->links[li].serialno)return OP_EINVAL;
+    _data+=4;
+  }
+  index=(OpusSeekEntry *)_ogg_malloc(sizeof(*index)*(nindex>0?nindex:1));
+  if(OP_UNLIKELY(index==NULL))return OP_EFAULT;
+  for(ei=0;ei<nindex;ei++){
+    OpusSeekEntry     *e;
+    const OggOpusLink *link;
+    opus_int64         boundary;
+    opus_uint32        flags;
+    e=index+ei;
+    e->gp=op_get_le64(_data);
+    e->offset=op_get_le64(_data+8);
+    e->size=op_get_le32(_data+16);
+    flags=op_get_le32(_data+20);
+    e->li=(int)(flags>>1);
+    e->continues=(int)(flags&1);
+    _data+=OP_SEEK_INDEX_ENTRY_SIZE;
+    /*Entries must be in file order and inside their links.*/
+    if(e->li>=_of->nlinks||(ei>0&&(e->li<e[-1].li||e->offset<=e[-1].offset))){
+      _ogg_free(index);
+      return OP_EBADHEADER;
+    }
+    link=_of->links+e->li;
+    boundary=e->li+1<_of->nlinks?_of->links[e->li+1].offset:_of->end;
+    if(e->offset<link->data_offset||e->size<27
+     ||e->offset+e->size>boundary){
+      _ogg_free(index);
+      return OP_EBADHEADER;
+    }
+  }
+  _ogg_free(_of->seek_index);
+  _of->seek_index=index;
+  _of->nseek_index=(int)nindex;
+  return 0;
+}
+
 opus_int64 op_raw_tell(const OggOpusFile *_of){
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
   return _of->offset;
@@ -2695,7 +3340,8 @@ static ogg_int64_t op_get_pcm_offset(const OggOpusFile *_of,
   return pcm_offset;
 }
 
-ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
+/*The body of op_pcm_tell(), returning an offset at 48 kHz.*/
+static ogg_int64_t op_pcm_tell_48k(const OggOpusFile *_of){
   ogg_int64_t gp;
   int         nbuffered;
   int         li;
@@ -2703,7 +3349,7 @@ ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
   gp=_of->prev_packet_gp;
   if(gp==-1)return 0;
   nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0);
-  OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered));
+  OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered*_of->rate_div));
   li=_of->seekable?_of->cur_link:0;
   if(op_granpos_add(&gp,gp,_of->cur_discard_count)<0){
     gp=_of->links[li].pcm_end;
@@ -2711,6 +3357,10 @@ ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
   return op_get_pcm_offset(_of,gp,li);
 }
 
+ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
+  return op_rate_from_48k(_of,op_pcm_tell_48k(_of));
+}
+
 void op_set_decode_callback(OggOpusFile *_of,
  op_decode_cb_func _decode_cb,void *_ctx){
   _of->decode_cb=_decode_cb;
@@ -2739,6 +3389,28 @@ void op_set_dither_enabled(OggOpusFile *_of,int _enabled){
 #endif
 }
 
+int op_set_decode_rate(OggOpusFile *_of,opus_int32 _rate){
+  int rate_div;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(_rate!=8000&&_rate!=12000&&_rate!=16000&&_rate!=24000&&_rate!=48000){
+    return OP_EINVAL;
+  }
+  rate_div=(int)(48000/_rate);
+  if(rate_div==_of->rate_div)return 0;
+  /*Decoded samples, the bitrate tracking, and the decoder itself all depend on
+     the rate, so only allow changing it before anything has been decoded.*/
+  if(_of->ready_state>=OP_INITSET&&(_of->bytes_tracked>0
+   ||_of->od_buffer_pos<_of->od_buffer_size)){
+    return OP_EINVAL;
+  }
+  _of->rate_div=rate_div;
+  opus_multistream_decoder_destroy(_of->od);
+  _of->od=NULL;
+  if(_of->ready_state<OP_INITSET)return 0;
+  _of->ready_state=OP_STREAMSET;
+  return op_make_decode_ready(_of);
+}
+
 /*Allocate the decoder scratch buffer.
   This is done lazily, since if the user provides large enough buffers, we'll
    never need it.*/
@@ -2828,6 +3500,8 @@ static int op_read_native(OggOpusFile *_of,
         opus_int32        cur_discard_count;
         int               duration;
         int               trimmed_duration;
+        int               skip;
+        int               rate_div;
         pop=_of->op+op_pos++;
         _of->op_pos=op_pos;
         cur_discard_count=_of->cur_discard_count;
@@ -2847,6 +3521,19 @@ static int op_read_native(OggOpusFile *_of,
           }
         }
         _of->prev_packet_gp=pop->granulepos;
+        /*Perform pre-skip/pre-roll.*/
+        skip=(int)OP_MIN(trimmed_duration,cur_discard_count);
+        _of->cur_discard_count=cur_discard_count-skip;
+        rate_div=_of->rate_div;
+        if(OP_UNLIKELY(rate_div>1)){
+          /*At a reduced decode rate the decoder keeps every rate_div'th
+             sample counting from the start of the packet, and packet
+             durations are all multiples of 120, so skipped and trimmed
+             samples round up to the next one we keep.*/
+          duration/=rate_div;
+          skip=(skip+rate_div-1)/rate_div;
+          trimmed_duration=(trimmed_duration+rate_div-1)/rate_div;
+        }
         if(OP_UNLIKELY(duration*nchannels>_buf_size)){
           op_sample *buf;
           /*If the user's buffer is too small, decode into a scratch buffer.*/
@@ -2858,36 +3545,27 @@ static int op_read_native(OggOpusFile *_of,
           }
           ret=op_decode(_of,buf,pop,duration,nchannels);
           if(OP_UNLIKELY(ret<0))return ret;
-          /*Perform pre-skip/pre-roll.*/
-          od_buffer_pos=(int)OP_MIN(trimmed_duration,cur_discard_count);
-          cur_discard_count-=od_buffer_pos;
-          _of->cur_discard_count=cur_discard_count;
-          _of->od_buffer_pos=od_buffer_pos;
+          _of->od_buffer_pos=skip;
           _of->od_buffer_size=trimmed_duration;
           /*Update bitrate tracking based on the actual samples we used from
              what was decoded.*/
           _of->bytes_tracked+=pop->bytes;
-          _of->samples_tracked+=trimmed_duration-od_buffer_pos;
+          _of->samples_tracked+=(trimmed_duration-skip)*rate_div;
         }
         else{
           /*Otherwise decode directly into the user's buffer.*/
           ret=op_decode(_of,_pcm,pop,duration,nchannels);
           if(OP_UNLIKELY(ret<0))return ret;
           if(OP_LIKELY(trimmed_duration>0)){
-            /*Perform pre-skip/pre-roll.*/
-            od_buffer_pos=(int)OP_MIN(trimmed_duration,cur_discard_count);
-            cur_discard_count-=od_buffer_pos;
-            _of->cur_discard_count=cur_discard_count;
-            trimmed_duration-=od_buffer_pos;
-            if(OP_LIKELY(trimmed_duration>0)
-             &&OP_UNLIKELY(od_buffer_pos>0)){
-              memmove(_pcm,_pcm+od_buffer_pos*nchannels,
+            trimmed_duration-=skip;
+            if(OP_LIKELY(trimmed_duration>0)&&OP_UNLIKELY(skip>0)){
+              memmove(_pcm,_pcm+skip*nchannels,
                sizeof(*_pcm)*trimmed_duration*nchannels);
             }
             /*Update bitrate tracking based on the actual samples we used from
                what was decoded.*/
             _of->bytes_tracked+=pop->bytes;
-            _of->samples_tracked+=trimmed_duration;
+            _of->samples_tracked+=trimmed_duration*rate_div;
             if(OP_LIKELY(trimmed_duration>0)){
               if(_li!=NULL)*_li=_of->cur_link;
               return trimmed_duration;
@@ -3028,12 +3706,17 @@ static int op_stereo_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
   _nsamples=OP_MIN(_nsamples,_dst_sz>>1);
   if(_nchannels==2)memcpy(_dst,_src,_nsamples*2*sizeof(*_src));
   else{
-    opus_int16 *dst;
-    int         i;
+    op_downmix_short_func  downmix;
+    opus_int16            *dst;
+    int                    i;
     dst=(opus_int16 *)_dst;
     if(_nchannels==1){
       for(i=0;i<_nsamples;i++)dst[2*i+0]=dst[2*i+1]=_src[i];
     }
+    else if((downmix=op_downmix_short_select(_nchannels))!=NULL){
+      (*downmix)(dst,_src,_nsamples,_nchannels,
+       OP_STEREO_DOWNMIX_Q14[_nchannels-3]);
+    }
     else{
       for(i=0;i<_nsamples;i++){
         opus_int32 l;
@@ -3063,13 +3746,16 @@ int op_read_stereo(OggOpusFile *_of,opus_int16 *_pcm,int _buf_size){
 
 static int op_short2float_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
  op_sample *_src,int _nsamples,int _nchannels){
-  float *dst;
-  int    i;
+  op_short2float_func  convert;
+  float               *dst;
+  int                  i;
   (void)_of;
   dst=(float *)_dst;
   if(OP_UNLIKELY(_nsamples*_nchannels>_dst_sz))_nsamples=_dst_sz/_nchannels;
   _dst_sz=_nsamples*_nchannels;
-  for(i=0;i<_dst_sz;i++)dst[i]=(1.0F/32768)*_src[i];
+  convert=op_short2float_select();
+  if(convert!=NULL)(*convert)(dst,_src,_dst_sz);
+  else for(i=0;i<_dst_sz;i++)dst[i]=(1.0F/32768)*_src[i];
   return _nsamples;
 }
 
@@ -3097,21 +3783,36 @@ static int op_short2float_stereo_filter(OggOpusFile *_of,
     return op_short2float_filter(_of,dst,_dst_sz,_src,_nsamples,2);
   }
   else{
+    op_downmix_float_func downmix;
     /*For 5 or more channels, we convert to floats and then downmix (so that we
        don't risk clipping).*/
-    for(i=0;i<_nsamples;i++){
-      float l;
-      float r;
-      int   ci;
-      l=r=0;
-      for(ci=0;ci<_nchannels;ci++){
-        float s;
-        s=(1.0F/32768)*_src[_nchannels*i+ci];
-        l+=OP_STEREO_DOWNMIX[_nchannels-3][ci][0]*s;
-        r+=OP_STEREO_DOWNMIX[_nchannels-3][ci][1]*s;
+    downmix=op_downmix_float_select(_nchannels);
+    if(downmix!=NULL){
+      float buf[OP_NCHANNELS_MAX*120];
+      int   n;
+      /*Converting first rounds the same way as the loop below.*/
+      for(i=0;i<_nsamples;i+=n){
+        n=OP_MIN(_nsamples-i,120);
+        op_short2float_filter(_of,buf,n*_nchannels,
+         _src+_nchannels*i,n,_nchannels);
+        (*downmix)(dst+2*i,buf,n,_nchannels,OP_STEREO_DOWNMIX[_nchannels-3]);
+      }
+    }
+    else{
+      for(i=0;i<_nsamples;i++){
+        float l;
+        float r;
+        int   ci;
+        l=r=0;
+        for(ci=0;ci<_nchannels;ci++){
+          float s;
+          s=(1.0F/32768)*_src[_nchannels*i+ci];
+          l+=OP_STEREO_DOWNMIX[_nchannels-3][ci][0]*s;
+          r+=OP_STEREO_DOWNMIX[_nchannels-3][ci][1]*s;
+        }
+        dst[2*i+0]=l;
+        dst[2*i+1]=r;
       }
-      dst[2*i+0]=l;
-      dst[2*i+1]=r;
     }
   }
   return _nsamples;
@@ -3137,7 +3838,7 @@ int op_read_float_stereo(OggOpusFile *_of,float *_pcm,int _buf_size){
   It was originally written by Greg Maxwell.*/
 
 static opus_uint32 op_rand(opus_uint32 _seed){
-  return _seed*96314165+907633515&0xFFFFFFFFU;
+  return _seed*OP_PRNG_MUL+OP_PRNG_ADD&0xFFFFFFFFU;
 }
 
 /*This implements 16-bit quantization with full triangular dither and IIR noise
@@ -3160,92 +3861,97 @@ static opus_uint32 op_rand(opus_uint32 _seed){
   The attenuation is probably also helpful to prevent clipping in the DAC
    reconstruction filters or downstream resampling, in any case.*/
 
-# define OP_GAIN (32753.0F)
-
-# define OP_PRNG_GAIN (1.0F/0xFFFFFFFF)
-
-/*48 kHz noise shaping filter, sd=2.34.*/
-
-static const float OP_FCOEF_B[4]={
-  2.2374F,-0.7339F,-0.1251F,-0.6033F
-};
-
-static const float OP_FCOEF_A[4]={
-  0.9030F,0.0116F,-0.5853F,-0.2571F
-};
+static int op_dither_c(opus_int16 *_dst,const float *_src,
+ int _nsamples,int _nchannels,float *_dither_a,float *_dither_b,
+ opus_uint32 *_seed,int _mute){
+  opus_uint32 seed;
+  int         mute;
+  int         ci;
+  int         i;
+  seed=*_seed;
+  mute=_mute;
+  for(i=0;i<_nsamples;i++){
+    int silent;
+    silent=1;
+    for(ci=0;ci<_nchannels;ci++){
+      float r;
+      float s;
+      float err;
+      int   si;
+      int   j;
+      s=_src[_nchannels*i+ci];
+      silent&=s==0;
+      s*=OP_GAIN;
+      err=0;
+      for(j=0;j<4;j++){
+        err+=OP_FCOEF_B[j]*_dither_b[ci*4+j]-OP_FCOEF_A[j]*_dither_a[ci*4+j];
+      }
+      for(j=3;j-->0;)_dither_a[ci*4+j+1]=_dither_a[ci*4+j];
+      for(j=3;j-->0;)_dither_b[ci*4+j+1]=_dither_b[ci*4+j];
+      _dither_a[ci*4]=err;
+      s-=err;
+      if(mute>16)r=0;
+      else{
+        seed=op_rand(seed);
+        r=seed*OP_PRNG_GAIN;
+        seed=op_rand(seed);
+        r-=seed*OP_PRNG_GAIN;
+      }
+      /*Clamp in float out of paranoia that the input will be > 96 dBFS and
+         wrap if the integer is clamped.*/
+      si=op_float2int(OP_CLAMP(-32768,s+r,32767));
+      _dst[_nchannels*i+ci]=(opus_int16)si;
+      /*Including clipping in the noise shaping is generally disastrous: the
+         futile effort to restore the clipped energy results in more clipping.
+        However, small amounts---at the level which could normally be created
+         by dither and rounding---are harmless and can even reduce clipping
+         somewhat due to the clipping sometimes reducing the dither + rounding
+         error.*/
+      _dither_b[ci*4]=mute>16?0:OP_CLAMP(-1.5F,si-s,1.5F);
+    }
+    mute++;
+    if(!silent)mute=0;
+  }
+  *_seed=seed;
+  return mute;
+}
 
 static int op_float2short_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
  float *_src,int _nsamples,int _nchannels){
   opus_int16 *dst;
-  int         ci;
   int         i;
   dst=(opus_int16 *)_dst;
   if(OP_UNLIKELY(_nsamples*_nchannels>_dst_sz))_nsamples=_dst_sz/_nchannels;
 # if defined(OP_SOFT_CLIP)
   if(_of->state_channel_count!=_nchannels){
+    int ci;
     for(ci=0;ci<_nchannels;ci++)_of->clip_state[ci]=0;
   }
   opus_pcm_soft_clip(_src,_nsamples,_nchannels,_of->clip_state);
 # endif
   if(_of->dither_disabled){
-    for(i=0;i<_nchannels*_nsamples;i++){
-      dst[i]=op_float2int(OP_CLAMP(-32768,32768.0F*_src[i],32767));
+    op_float2short_func convert;
+    convert=op_float2short_select();
+    if(convert!=NULL)(*convert)(dst,_src,_nchannels*_nsamples);
+    else{
+      for(i=0;i<_nchannels*_nsamples;i++){
+        dst[i]=op_float2int(OP_CLAMP(-32768,32768.0F*_src[i],32767));
+      }
     }
   }
   else{
-    opus_uint32 seed;
-    int         mute;
-    seed=_of->dither_seed;
+    op_dither_func dither;
+    int            mute;
     mute=_of->dither_mute;
     if(_of->state_channel_count!=_nchannels)mute=65;
     /*In order to avoid replacing digital silence with quiet dither noise, we
        mute if the output has been silent for a while.*/
     if(mute>64)memset(_of->dither_a,0,sizeof(*_of->dither_a)*4*_nchannels);
-    for(i=0;i<_nsamples;i++){
-      int silent;
-      silent=1;
-      for(ci=0;ci<_nchannels;ci++){
-        float r;
-        float s;
-        float err;
-        int   si;
-        int   j;
-        s=_src[_nchannels*i+ci];
-        silent&=s==0;
-        s*=OP_GAIN;
-        err=0;
-        for(j=0;j<4;j++){
-          err+=OP_FCOEF_B[j]*_of->dither_b[ci*4+j]
-           -OP_FCOEF_A[j]*_of->dither_a[ci*4+j];
-        }
-        for(j=3;j-->0;)_of->dither_a[ci*4+j+1]=_of->dither_a[ci*4+j];
-        for(j=3;j-->0;)_of->dither_b[ci*4+j+1]=_of->dither_b[ci*4+j];
-        _of->dither_a[ci*4]=err;
-        s-=err;
-        if(mute>16)r=0;
-        else{
-          seed=op_rand(seed);
-          r=seed*OP_PRNG_GAIN;
-          seed=op_rand(seed);
-          r-=seed*OP_PRNG_GAIN;
-        }
-        /*Clamp in float out of paranoia that the input will be > 96 dBFS and
-           wrap if the integer is clamped.*/
-        si=op_float2int(OP_CLAMP(-32768,s+r,32767));
-        dst[_nchannels*i+ci]=(opus_int16)si;
-        /*Including clipping in the noise shaping is generally disastrous: the
-           futile effort to restore the clipped energy results in more clipping.
-          However, small amounts---at the level which could normally be created
-           by dither and rounding---are harmless and can even reduce clipping
-           somewhat due to the clipping sometimes reducing the dither + rounding
-           error.*/
-        _of->dither_b[ci*4]=mute>16?0:OP_CLAMP(-1.5F,si-s,1.5F);
-      }
-      mute++;
-      if(!silent)mute=0;
-    }
+    dither=op_dither_select(_nchannels);
+    if(dither==NULL)dither=op_dither_c;
+    mute=(*dither)(dst,_src,_nsamples,_nchannels,
+     _of->dither_a,_of->dither_b,&_of->dither_seed,mute);
     _of->dither_mute=OP_MIN(mute,65);
-    _of->dither_seed=seed;
   }
   _of->state_channel_count=_nchannels;
   return _nsamples;
@@ -3266,12 +3972,17 @@ static int op_stereo_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
   _nsamples=OP_MIN(_nsamples,_dst_sz>>1);
   if(_nchannels==2)memcpy(_dst,_src,_nsamples*2*sizeof(*_src));
   else{
-    float *dst;
-    int    i;
+    op_downmix_float_func  downmix;
+    float                 *dst;
+    int                    i;
     dst=(float *)_dst;
     if(_nchannels==1){
       for(i=0;i<_nsamples;i++)dst[2*i+0]=dst[2*i+1]=_src[i];
     }
+    else if((downmix=op_downmix_float_select(_nchannels))!=NULL){
+      (*downmix)(dst,_src,_nsamples,_nchannels,
+       OP_STEREO_DOWNMIX[_nchannels-3]);
+    }
     else{
       for(i=0;i<_nsamples;i++){
         float l;
@@ -26,6 +26,11 @@
 #include <string.h>
 #if defined(_WIN32)
 # include <io.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
 #endif
 
 typedef struct OpusMemStream OpusMemStream;
@@ -364,3 +369,76 @@ void *op_mem_stream_create(OpusFileCallbacks *_cb,
   }
   return stream;
 }
+
+#if !defined(_WIN32)
+
+/*A memory stream over a read-only mapping of a whole file.
+  Reading, seeking and telling are shared with OpusMemStream; only closing
+   differs, as it unmaps the file.*/
+static int op_mmap_close(void *_stream){
+  OpusMemStream *stream;
+  stream=(OpusMemStream *)_stream;
+  munmap((void *)stream->data,(size_t)stream->size);
+  _ogg_free(_stream);
+  return 0;
+}
+
+static const OpusFileCallbacks OP_MMAP_CALLBACKS={
+  op_mem_read,
+  op_mem_seek,
+  op_mem_tell,
+  op_mmap_close
+};
+
+void *op_mmap_stream_create(OpusFileCallbacks *_cb,const char *_path){
+  OpusMemStream *stream;
+  struct stat    st;
+  void          *data;
+  int            fd;
+  fd=open(_path,O_RDONLY);
+  if(fd<0)return NULL;
+  /*Empty files cannot be mapped, and pipes and devices have no fixed size.*/
+  if(fstat(fd,&st)<0||!S_ISREG(st.st_mode)||st.st_size<=0
+   ||(opus_uint64)st.st_size>(opus_uint64)OP_MEM_SIZE_MAX){
+    close(fd);
+    return NULL;
+  }
+  data=mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  /*The mapping stays valid after the descriptor is closed.*/
+  close(fd);
+  if(data==MAP_FAILED)return NULL;
+# if defined(MADV_SEQUENTIAL)
+  madvise(data,(size_t)st.st_size,MADV_SEQUENTIAL);
+# endif
+  stream=(OpusMemStream *)_ogg_malloc(sizeof(*stream));
+  if(stream==NULL){
+    munmap(data,(size_t)st.st_size);
+    return NULL;
+  }
+  *_cb=*&OP_MMAP_CALLBACKS;
+  stream->data=(const unsigned char *)data;
+  stream->size=(ptrdiff_t)st.st_size;
+  stream->pos=0;
+  return stream;
+}
+
+#else
+
+void *op_mmap_stream_create(OpusFileCallbacks *_cb,const char *_path){
+  (void)_cb;
+  (void)_path;
+  return NULL;
+}
+
+#endif
+
+int op_mem_stream_region(const OpusFileCallbacks *_cb,void *_stream,
+ const unsigned char **_data,opus_int64 *_size){
+  OpusMemStream *stream;
+  /*Both memory and mapped streams read through op_mem_read().*/
+  if(_cb->read!=op_mem_read)return 0;
+  stream=(OpusMemStream *)_stream;
+  *_data=stream->data;
+  *_size=(opus_int64)stream->size;
+  return 1;
+}
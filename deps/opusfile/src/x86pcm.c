@@ -0,0 +1,630 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE libopusfile SOFTWARE CODEC SOURCE CODE. *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE libopusfile SOURCE CODE IS (C) COPYRIGHT 2012                *
+ * by the Xiph.Org Foundation and contributors http://www.xiph.org/ *
+ *                                                                  *
+ ********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "internal.h"
+
+/*SSE2 and AVX2 versions of the PCM conversion loops in opusfile.c.
+  Their output must match the C code bit for bit, so they are only built on
+   x86-64, which does float math in SSE registers rather than on the x87
+   stack, and they do every float operation of the C code in the same order.
+  The kernels that round to integers also need lrintf() (which rounds like
+   cvtps2dq) in the C code.
+  FMA is never enabled, since fusing a multiply-add changes its rounding.*/
+
+#if (defined(__x86_64__)||defined(_M_X64)) \
+ &&(OP_GNUC_PREREQ(4,9)||defined(__clang__)||defined(_MSC_VER))
+# define OP_X86_SIMD (1)
+# if !defined(OP_FIXED_POINT)&&defined(OP_HAVE_LRINTF)
+#  define OP_X86_SIMD_ROUND (1)
+# endif
+#endif
+
+#if defined(OP_X86_SIMD)
+# include <stdlib.h>
+# include <string.h>
+# include <immintrin.h>
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define OP_TARGET_AVX2
+# else
+#  define OP_TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+
+# define OP_CPU_SSE2 (1)
+# define OP_CPU_AVX2 (2)
+
+static int op_cpu_detect(void){
+  const char *cap;
+  int         flags;
+  /*SSE2 is part of x86-64.*/
+  flags=OP_CPU_SSE2;
+# if defined(_MSC_VER)
+  {
+    int info[4];
+    __cpuid(info,0);
+    if(info[0]>=7){
+      __cpuid(info,1);
+      /*AVX2 also needs the OS to save the YMM registers (OSXSAVE, AVX, and
+         XCR0 bits 1 and 2).*/
+      if((info[2]&0x18000000)==0x18000000&&(_xgetbv(0)&6)==6){
+        __cpuidex(info,7,0);
+        if(info[1]&0x20)flags|=OP_CPU_AVX2;
+      }
+    }
+  }
+# else
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))flags|=OP_CPU_AVX2;
+# endif
+  cap=getenv("OPUSFILE_SIMD");
+  if(cap!=NULL){
+    if(strcmp(cap,"none")==0)flags=0;
+    else if(strcmp(cap,"sse2")==0)flags&=OP_CPU_SSE2;
+    /*Still only if the CPU has it.*/
+    else if(strcmp(cap,"avx2")==0)flags&=OP_CPU_SSE2|OP_CPU_AVX2;
+  }
+  return flags;
+}
+
+static int op_cpu_flags(void){
+  /*Every thread computes the same value, so a race here is harmless.*/
+  static volatile int flags=-1;
+  int                 ret;
+  ret=flags;
+  if(OP_UNLIKELY(ret<0))flags=ret=op_cpu_detect();
+  return ret;
+}
+
+# if defined(OP_X86_SIMD_ROUND)
+
+/*Computes the LCG of op_rand() stepped _n times: _mul*seed+_add.*/
+static void op_rand_jump(opus_uint32 *_mul,opus_uint32 *_add,int _n){
+  opus_uint32 mul;
+  opus_uint32 add;
+  mul=1;
+  add=0;
+  while(_n-->0){
+    mul=mul*OP_PRNG_MUL&0xFFFFFFFFU;
+    add=add*OP_PRNG_MUL+OP_PRNG_ADD&0xFFFFFFFFU;
+  }
+  *_mul=mul;
+  *_add=add;
+}
+
+/*Per-lane PRNG steps and filter state for up to 8 channels.
+  Channel ci draws the (2*ci+1)th and (2*ci+2)th values after the seed, as
+   in the C code, and the seed moves 2*_nchannels steps per sample.*/
+typedef struct op_dither_lanes op_dither_lanes;
+
+struct op_dither_lanes{
+  opus_uint32 mul1[8];
+  opus_uint32 add1[8];
+  opus_uint32 mul2[8];
+  opus_uint32 add2[8];
+  opus_uint32 step_mul;
+  opus_uint32 step_add;
+  /*Filter taps transposed so that a[j*8+ci] is tap j of channel ci.
+    Unused lanes stay 0.*/
+  float       a[32];
+  float       b[32];
+};
+
+static void op_dither_lanes_init(op_dither_lanes *_l,int _nchannels,
+ const float *_dither_a,const float *_dither_b){
+  int ci;
+  int j;
+  memset(_l,0,sizeof(*_l));
+  for(ci=0;ci<_nchannels;ci++){
+    op_rand_jump(_l->mul1+ci,_l->add1+ci,2*ci+1);
+    op_rand_jump(_l->mul2+ci,_l->add2+ci,2*ci+2);
+    for(j=0;j<4;j++){
+      _l->a[j*8+ci]=_dither_a[ci*4+j];
+      _l->b[j*8+ci]=_dither_b[ci*4+j];
+    }
+  }
+  op_rand_jump(&_l->step_mul,&_l->step_add,2*_nchannels);
+}
+
+static void op_dither_lanes_save(const op_dither_lanes *_l,int _nchannels,
+ float *_dither_a,float *_dither_b){
+  int ci;
+  int j;
+  for(ci=0;ci<_nchannels;ci++){
+    for(j=0;j<4;j++){
+      _dither_a[ci*4+j]=_l->a[j*8+ci];
+      _dither_b[ci*4+j]=_l->b[j*8+ci];
+    }
+  }
+}
+
+/*SSE2 has no 32-bit multiply that keeps the low half, so do the even and odd
+   lanes separately.*/
+static __m128i op_mullo_epi32_sse2(__m128i _a,__m128i _b){
+  __m128i even;
+  __m128i odd;
+  even=_mm_mul_epu32(_a,_b);
+  odd=_mm_mul_epu32(_mm_srli_epi64(_a,32),_mm_srli_epi64(_b,32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),
+   _mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+}
+
+/*Converts unsigned 32-bit integers to float, rounding like a C cast.
+  Both 16-bit halves convert exactly and the scaling is exact, so the only
+   rounding is in the final sum.*/
+static __m128 op_cvtepu32_ps_sse2(__m128i _x){
+  __m128 hi;
+  __m128 lo;
+  hi=_mm_cvtepi32_ps(_mm_srli_epi32(_x,16));
+  lo=_mm_cvtepi32_ps(_mm_and_si128(_x,_mm_set1_epi32(0xFFFF)));
+  return _mm_add_ps(_mm_mul_ps(hi,_mm_set1_ps(65536.0F)),lo);
+}
+
+/*Quantizes one group of 4 channels of one sample.
+  Returns the mask of lanes whose input was exactly 0.*/
+static int op_dither_group_sse2(opus_int16 *_dst,const float *_src,
+ float *_a,float *_b,const op_dither_lanes *_l,int _g,
+ __m128i _seed,int _mute){
+  __m128  a[4];
+  __m128  b[4];
+  __m128  s;
+  __m128  err;
+  __m128  r;
+  __m128i si;
+  int     zero;
+  int     j;
+  for(j=0;j<4;j++){
+    a[j]=_mm_loadu_ps(_a+j*8+_g);
+    b[j]=_mm_loadu_ps(_b+j*8+_g);
+  }
+  s=_mm_loadu_ps(_src);
+  zero=_mm_movemask_ps(_mm_cmpeq_ps(s,_mm_setzero_ps()));
+  s=_mm_mul_ps(s,_mm_set1_ps(OP_GAIN));
+  err=_mm_setzero_ps();
+  for(j=0;j<4;j++){
+    err=_mm_add_ps(err,_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(OP_FCOEF_B[j]),b[j]),
+     _mm_mul_ps(_mm_set1_ps(OP_FCOEF_A[j]),a[j])));
+  }
+  _mm_storeu_ps(_a+3*8+_g,a[2]);
+  _mm_storeu_ps(_a+2*8+_g,a[1]);
+  _mm_storeu_ps(_a+1*8+_g,a[0]);
+  _mm_storeu_ps(_a+_g,err);
+  _mm_storeu_ps(_b+3*8+_g,b[2]);
+  _mm_storeu_ps(_b+2*8+_g,b[1]);
+  _mm_storeu_ps(_b+1*8+_g,b[0]);
+  s=_mm_sub_ps(s,err);
+  if(_mute>16){
+    si=_mm_cvtps_epi32(_mm_max_ps(_mm_set1_ps(-32768),
+     _mm_min_ps(s,_mm_set1_ps(32767))));
+    _mm_storeu_ps(_b+_g,_mm_setzero_ps());
+  }
+  else{
+    __m128i seed;
+    __m128  e;
+    seed=_mm_add_epi32(op_mullo_epi32_sse2(
+     _mm_loadu_si128((const __m128i *)(_l->mul1+_g)),_seed),
+     _mm_loadu_si128((const __m128i *)(_l->add1+_g)));
+    r=_mm_mul_ps(op_cvtepu32_ps_sse2(seed),_mm_set1_ps(OP_PRNG_GAIN));
+    seed=_mm_add_epi32(op_mullo_epi32_sse2(
+     _mm_loadu_si128((const __m128i *)(_l->mul2+_g)),_seed),
+     _mm_loadu_si128((const __m128i *)(_l->add2+_g)));
+    r=_mm_sub_ps(r,
+     _mm_mul_ps(op_cvtepu32_ps_sse2(seed),_mm_set1_ps(OP_PRNG_GAIN)));
+    si=_mm_cvtps_epi32(_mm_max_ps(_mm_set1_ps(-32768),
+     _mm_min_ps(_mm_add_ps(s,r),_mm_set1_ps(32767))));
+    e=_mm_sub_ps(_mm_cvtepi32_ps(si),s);
+    _mm_storeu_ps(_b+_g,_mm_max_ps(_mm_set1_ps(-1.5F),
+     _mm_min_ps(e,_mm_set1_ps(1.5F))));
+  }
+  _mm_storel_epi64((__m128i *)_dst,_mm_packs_epi32(si,si));
+  return zero;
+}
+
+/*Handles 2 to 8 channels in one or two groups of 4.*/
+static int op_dither_sse2(opus_int16 *_dst,const float *_src,
+ int _nsamples,int _nchannels,float *_dither_a,float *_dither_b,
+ opus_uint32 *_seed,int _mute){
+  op_dither_lanes lanes;
+  float           in[8];
+  opus_int16      out[8];
+  opus_uint32     seed;
+  int             ngroups;
+  int             all;
+  int             mute;
+  int             i;
+  op_dither_lanes_init(&lanes,_nchannels,_dither_a,_dither_b);
+  /*The padding lanes read 0, so they never make a sample look non-silent.*/
+  memset(in,0,sizeof(in));
+  ngroups=_nchannels+3>>2;
+  all=(1<<4*ngroups)-1;
+  seed=*_seed;
+  mute=_mute;
+  for(i=0;i<_nsamples;i++){
+    __m128i vseed;
+    int     zero;
+    int     g;
+    memcpy(in,_src+_nchannels*i,_nchannels*sizeof(*in));
+    vseed=_mm_set1_epi32((int)seed);
+    zero=0;
+    for(g=0;g<ngroups;g++){
+      zero|=op_dither_group_sse2(out+4*g,in+4*g,lanes.a,lanes.b,&lanes,4*g,
+       vseed,mute)<<4*g;
+    }
+    memcpy(_dst+_nchannels*i,out,_nchannels*sizeof(*out));
+    if(mute<=16)seed=lanes.step_mul*seed+lanes.step_add&0xFFFFFFFFU;
+    mute++;
+    if(zero!=all)mute=0;
+  }
+  op_dither_lanes_save(&lanes,_nchannels,_dither_a,_dither_b);
+  *_seed=seed;
+  return mute;
+}
+
+OP_TARGET_AVX2
+static __m256 op_cvtepu32_ps_avx2(__m256i _x){
+  __m256 hi;
+  __m256 lo;
+  hi=_mm256_cvtepi32_ps(_mm256_srli_epi32(_x,16));
+  lo=_mm256_cvtepi32_ps(_mm256_and_si256(_x,_mm256_set1_epi32(0xFFFF)));
+  return _mm256_add_ps(_mm256_mul_ps(hi,_mm256_set1_ps(65536.0F)),lo);
+}
+
+/*Handles 5 to 8 channels in one group of 8, keeping the state in registers
+   for the whole call.*/
+OP_TARGET_AVX2
+static int op_dither_avx2(opus_int16 *_dst,const float *_src,
+ int _nsamples,int _nchannels,float *_dither_a,float *_dither_b,
+ opus_uint32 *_seed,int _mute){
+  op_dither_lanes lanes;
+  float           in[8];
+  opus_int16      out[8];
+  __m256          a[4];
+  __m256          b[4];
+  __m256i         mul1;
+  __m256i         add1;
+  __m256i         mul2;
+  __m256i         add2;
+  opus_uint32     seed;
+  int             all;
+  int             mute;
+  int             i;
+  int             j;
+  op_dither_lanes_init(&lanes,_nchannels,_dither_a,_dither_b);
+  for(j=0;j<4;j++){
+    a[j]=_mm256_loadu_ps(lanes.a+j*8);
+    b[j]=_mm256_loadu_ps(lanes.b+j*8);
+  }
+  mul1=_mm256_loadu_si256((const __m256i *)lanes.mul1);
+  add1=_mm256_loadu_si256((const __m256i *)lanes.add1);
+  mul2=_mm256_loadu_si256((const __m256i *)lanes.mul2);
+  add2=_mm256_loadu_si256((const __m256i *)lanes.add2);
+  memset(in,0,sizeof(in));
+  all=0xFF;
+  seed=*_seed;
+  mute=_mute;
+  for(i=0;i<_nsamples;i++){
+    __m256  s;
+    __m256  err;
+    __m256i si;
+    int     zero;
+    memcpy(in,_src+_nchannels*i,_nchannels*sizeof(*in));
+    s=_mm256_loadu_ps(in);
+    zero=_mm256_movemask_ps(_mm256_cmp_ps(s,_mm256_setzero_ps(),_CMP_EQ_OQ));
+    s=_mm256_mul_ps(s,_mm256_set1_ps(OP_GAIN));
+    err=_mm256_setzero_ps();
+    for(j=0;j<4;j++){
+      err=_mm256_add_ps(err,
+       _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(OP_FCOEF_B[j]),b[j]),
+       _mm256_mul_ps(_mm256_set1_ps(OP_FCOEF_A[j]),a[j])));
+    }
+    a[3]=a[2];
+    a[2]=a[1];
+    a[1]=a[0];
+    a[0]=err;
+    b[3]=b[2];
+    b[2]=b[1];
+    b[1]=b[0];
+    s=_mm256_sub_ps(s,err);
+    if(mute>16){
+      si=_mm256_cvtps_epi32(_mm256_max_ps(_mm256_set1_ps(-32768),
+       _mm256_min_ps(s,_mm256_set1_ps(32767))));
+      b[0]=_mm256_setzero_ps();
+    }
+    else{
+      __m256i vseed;
+      __m256  r;
+      vseed=_mm256_set1_epi32((int)seed);
+      r=_mm256_mul_ps(op_cvtepu32_ps_avx2(
+       _mm256_add_epi32(_mm256_mullo_epi32(mul1,vseed),add1)),
+       _mm256_set1_ps(OP_PRNG_GAIN));
+      r=_mm256_sub_ps(r,_mm256_mul_ps(op_cvtepu32_ps_avx2(
+       _mm256_add_epi32(_mm256_mullo_epi32(mul2,vseed),add2)),
+       _mm256_set1_ps(OP_PRNG_GAIN)));
+      si=_mm256_cvtps_epi32(_mm256_max_ps(_mm256_set1_ps(-32768),
+       _mm256_min_ps(_mm256_add_ps(s,r),_mm256_set1_ps(32767))));
+      b[0]=_mm256_max_ps(_mm256_set1_ps(-1.5F),_mm256_min_ps(
+       _mm256_sub_ps(_mm256_cvtepi32_ps(si),s),_mm256_set1_ps(1.5F)));
+      seed=lanes.step_mul*seed+lanes.step_add&0xFFFFFFFFU;
+    }
+    _mm_storeu_si128((__m128i *)out,_mm_packs_epi32(
+     _mm256_castsi256_si128(si),_mm256_extracti128_si256(si,1)));
+    memcpy(_dst+_nchannels*i,out,_nchannels*sizeof(*out));
+    mute++;
+    if(zero!=all)mute=0;
+  }
+  for(j=0;j<4;j++){
+    _mm256_storeu_ps(lanes.a+j*8,a[j]);
+    _mm256_storeu_ps(lanes.b+j*8,b[j]);
+  }
+  op_dither_lanes_save(&lanes,_nchannels,_dither_a,_dither_b);
+  *_seed=seed;
+  return mute;
+}
+
+static __m128i op_float2int_sse2(__m128 _x){
+  _x=_mm_mul_ps(_x,_mm_set1_ps(32768.0F));
+  return _mm_cvtps_epi32(_mm_max_ps(_mm_set1_ps(-32768),
+   _mm_min_ps(_x,_mm_set1_ps(32767))));
+}
+
+static void op_float2short_sse2(opus_int16 *_dst,const float *_src,int _n){
+  int i;
+  for(i=0;i+8<=_n;i+=8){
+    _mm_storeu_si128((__m128i *)(_dst+i),_mm_packs_epi32(
+     op_float2int_sse2(_mm_loadu_ps(_src+i)),
+     op_float2int_sse2(_mm_loadu_ps(_src+i+4))));
+  }
+  if(i<_n){
+    float      in[8];
+    opus_int16 out[8];
+    memset(in,0,sizeof(in));
+    memcpy(in,_src+i,(_n-i)*sizeof(*in));
+    _mm_storeu_si128((__m128i *)out,_mm_packs_epi32(
+     op_float2int_sse2(_mm_loadu_ps(in)),op_float2int_sse2(_mm_loadu_ps(in+4))));
+    memcpy(_dst+i,out,(_n-i)*sizeof(*out));
+  }
+}
+
+OP_TARGET_AVX2
+static __m256i op_float2int_avx2(__m256 _x){
+  _x=_mm256_mul_ps(_x,_mm256_set1_ps(32768.0F));
+  return _mm256_cvtps_epi32(_mm256_max_ps(_mm256_set1_ps(-32768),
+   _mm256_min_ps(_x,_mm256_set1_ps(32767))));
+}
+
+OP_TARGET_AVX2
+static void op_float2short_avx2(opus_int16 *_dst,const float *_src,int _n){
+  int i;
+  for(i=0;i+16<=_n;i+=16){
+    __m256i s;
+    s=_mm256_packs_epi32(op_float2int_avx2(_mm256_loadu_ps(_src+i)),
+     op_float2int_avx2(_mm256_loadu_ps(_src+i+8)));
+    /*The pack works within 128-bit lanes, so put the quarters back in order.*/
+    _mm256_storeu_si256((__m256i *)(_dst+i),
+     _mm256_permute4x64_epi64(s,_MM_SHUFFLE(3,1,2,0)));
+  }
+  op_float2short_sse2(_dst+i,_src+i,_n-i);
+}
+
+# endif
+
+# if defined(OP_FIXED_POINT)
+
+static void op_short2float_sse2(float *_dst,const opus_int16 *_src,int _n){
+  int i;
+  for(i=0;i+8<=_n;i+=8){
+    __m128i s;
+    s=_mm_loadu_si128((const __m128i *)(_src+i));
+    /*Sign-extend by putting each sample in the top half of a lane.*/
+    _mm_storeu_ps(_dst+i,_mm_mul_ps(_mm_set1_ps(1.0F/32768),
+     _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s,s),16))));
+    _mm_storeu_ps(_dst+i+4,_mm_mul_ps(_mm_set1_ps(1.0F/32768),
+     _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s,s),16))));
+  }
+  for(;i<_n;i++)_dst[i]=(1.0F/32768)*_src[i];
+}
+
+OP_TARGET_AVX2
+static void op_short2float_avx2(float *_dst,const opus_int16 *_src,int _n){
+  int i;
+  for(i=0;i+8<=_n;i+=8){
+    _mm256_storeu_ps(_dst+i,_mm256_mul_ps(_mm256_set1_ps(1.0F/32768),
+     _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+     _mm_loadu_si128((const __m128i *)(_src+i))))));
+  }
+  for(;i<_n;i++)_dst[i]=(1.0F/32768)*_src[i];
+}
+
+/*Integer sums do not depend on their order, so this works one sample at a
+   time, with all of its channels in one vector.*/
+static void op_downmix_short_sse2(opus_int16 *_dst,const opus_int16 *_src,
+ int _nsamples,int _nchannels,const opus_int16 (*_matrix)[2]){
+  opus_int16 wl[8];
+  opus_int16 wr[8];
+  opus_int16 in[8];
+  __m128i    vwl;
+  __m128i    vwr;
+  int        ci;
+  int        i;
+  memset(wl,0,sizeof(wl));
+  memset(wr,0,sizeof(wr));
+  memset(in,0,sizeof(in));
+  for(ci=0;ci<_nchannels;ci++){
+    wl[ci]=_matrix[ci][0];
+    wr[ci]=_matrix[ci][1];
+  }
+  vwl=_mm_loadu_si128((const __m128i *)wl);
+  vwr=_mm_loadu_si128((const __m128i *)wr);
+  for(i=0;i<_nsamples;i++){
+    __m128i    s;
+    __m128i    l;
+    __m128i    r;
+    opus_int32 out;
+    memcpy(in,_src+_nchannels*i,_nchannels*sizeof(*in));
+    s=_mm_loadu_si128((const __m128i *)in);
+    l=_mm_madd_epi16(s,vwl);
+    r=_mm_madd_epi16(s,vwr);
+    /*Sum the 4 partial sums of each side, leaving l and r in lanes 0 and 1.*/
+    s=_mm_add_epi32(_mm_unpacklo_epi32(l,r),_mm_unpackhi_epi32(l,r));
+    s=_mm_add_epi32(s,_mm_srli_si128(s,8));
+    s=_mm_srai_epi32(_mm_add_epi32(s,_mm_set1_epi32(8192)),14);
+    out=_mm_cvtsi128_si32(_mm_packs_epi32(s,s));
+    memcpy(_dst+2*i,&out,sizeof(out));
+  }
+}
+
+# endif
+
+static void op_downmix_float_c(float *_dst,const float *_src,
+ int _nsamples,int _nchannels,const float (*_matrix)[2]){
+  int i;
+  for(i=0;i<_nsamples;i++){
+    float l;
+    float r;
+    int   ci;
+    l=r=0;
+    for(ci=0;ci<_nchannels;ci++){
+      l+=_matrix[ci][0]*_src[_nchannels*i+ci];
+      r+=_matrix[ci][1]*_src[_nchannels*i+ci];
+    }
+    _dst[2*i+0]=l;
+    _dst[2*i+1]=r;
+  }
+}
+
+/*The C code sums the channels of a sample in order, so these work on 4 or 8
+   samples at a time instead, one channel after another.
+  Each block is read in full before it is written, which keeps them safe in
+   place.*/
+static void op_downmix_float_sse2(float *_dst,const float *_src,
+ int _nsamples,int _nchannels,const float (*_matrix)[2]){
+  int i;
+  for(i=0;i+4<=_nsamples;i+=4){
+    const float *src;
+    __m128       l;
+    __m128       r;
+    int          ci;
+    src=_src+_nchannels*i;
+    l=r=_mm_setzero_ps();
+    for(ci=0;ci<_nchannels;ci++){
+      __m128 s;
+      s=_mm_set_ps(src[3*_nchannels+ci],src[2*_nchannels+ci],
+       src[_nchannels+ci],src[ci]);
+      l=_mm_add_ps(l,_mm_mul_ps(_mm_set1_ps(_matrix[ci][0]),s));
+      r=_mm_add_ps(r,_mm_mul_ps(_mm_set1_ps(_matrix[ci][1]),s));
+    }
+    _mm_storeu_ps(_dst+2*i,_mm_unpacklo_ps(l,r));
+    _mm_storeu_ps(_dst+2*i+4,_mm_unpackhi_ps(l,r));
+  }
+  op_downmix_float_c(_dst+2*i,_src+_nchannels*i,_nsamples-i,_nchannels,
+   _matrix);
+}
+
+OP_TARGET_AVX2
+static void op_downmix_float_avx2(float *_dst,const float *_src,
+ int _nsamples,int _nchannels,const float (*_matrix)[2]){
+  __m256i idx;
+  int     i;
+  idx=_mm256_mullo_epi32(_mm256_setr_epi32(0,1,2,3,4,5,6,7),
+   _mm256_set1_epi32(_nchannels));
+  for(i=0;i+8<=_nsamples;i+=8){
+    const float *src;
+    __m256       l;
+    __m256       r;
+    __m256       lo;
+    __m256       hi;
+    int          ci;
+    src=_src+_nchannels*i;
+    l=r=_mm256_setzero_ps();
+    for(ci=0;ci<_nchannels;ci++){
+      __m256 s;
+      s=_mm256_i32gather_ps(src+ci,idx,4);
+      l=_mm256_add_ps(l,_mm256_mul_ps(_mm256_set1_ps(_matrix[ci][0]),s));
+      r=_mm256_add_ps(r,_mm256_mul_ps(_mm256_set1_ps(_matrix[ci][1]),s));
+    }
+    /*The unpacks work within 128-bit lanes, giving samples 0, 1, 4, 5 and
+       2, 3, 6, 7.*/
+    lo=_mm256_unpacklo_ps(l,r);
+    hi=_mm256_unpackhi_ps(l,r);
+    _mm256_storeu_ps(_dst+2*i,_mm256_permute2f128_ps(lo,hi,0x20));
+    _mm256_storeu_ps(_dst+2*i+8,_mm256_permute2f128_ps(lo,hi,0x31));
+  }
+  op_downmix_float_sse2(_dst+2*i,_src+_nchannels*i,_nsamples-i,_nchannels,
+   _matrix);
+}
+
+#endif
+
+#if !defined(OP_FIXED_POINT)
+
+op_dither_func op_dither_select(int _nchannels){
+# if defined(OP_X86_SIMD_ROUND)
+  int flags;
+  /*A single channel fills too little of a vector to beat the C code.*/
+  if(_nchannels<2||_nchannels>8)return NULL;
+  flags=op_cpu_flags();
+  if(_nchannels>4&&(flags&OP_CPU_AVX2))return op_dither_avx2;
+  if(flags&OP_CPU_SSE2)return op_dither_sse2;
+# else
+  (void)_nchannels;
+# endif
+  return NULL;
+}
+
+op_float2short_func op_float2short_select(void){
+# if defined(OP_X86_SIMD_ROUND)
+  int flags;
+  flags=op_cpu_flags();
+  if(flags&OP_CPU_AVX2)return op_float2short_avx2;
+  if(flags&OP_CPU_SSE2)return op_float2short_sse2;
+# endif
+  return NULL;
+}
+
+#else
+
+op_short2float_func op_short2float_select(void){
+# if defined(OP_X86_SIMD)
+  int flags;
+  flags=op_cpu_flags();
+  if(flags&OP_CPU_AVX2)return op_short2float_avx2;
+  if(flags&OP_CPU_SSE2)return op_short2float_sse2;
+# endif
+  return NULL;
+}
+
+op_downmix_short_func op_downmix_short_select(int _nchannels){
+# if defined(OP_X86_SIMD)
+  if(_nchannels<3||_nchannels>8)return NULL;
+  if(op_cpu_flags()&OP_CPU_SSE2)return op_downmix_short_sse2;
+# else
+  (void)_nchannels;
+# endif
+  return NULL;
+}
+
+#endif
+
+op_downmix_float_func op_downmix_float_select(int _nchannels){
+#if defined(OP_X86_SIMD)
+  int flags;
+  if(_nchannels<3||_nchannels>8)return NULL;
+  flags=op_cpu_flags();
+  if(flags&OP_CPU_AVX2)return op_downmix_float_avx2;
+  if(flags&OP_CPU_SSE2)return op_downmix_float_sse2;
+#else
+  (void)_nchannels;
+#endif
+  return NULL;
+}
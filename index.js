@@ -1,4 +1,257 @@
 "use strict";
 
+var os = require('os');
+var stream = require('stream');
 var OpusFile = require('bindings')('node-opusfile');
+
+function promisify(call, callback) {
+  if (typeof callback === 'function') {
+    call(callback);
+    return;
+  }
+
+  return new Promise(function(resolve, reject) {
+    call(function(err, result) {
+      if (err) {
+        reject(err);
+      } else {
+        resolve(result);
+      }
+    });
+  });
+}
+
+// Runs Normalize on the libuv threadpool. Calls back with (err, result) when
+// a callback is given, otherwise returns a Promise for the result.
+//
+// The input may be an Ogg Opus file, decoded through opusfile straight at the
+// output sampleRate, or a stream of raw 133-byte Opus packets.
+//
+// Encoder options (defaults in brackets): sampleRate [16000], channels [1],
+// bitrate [16000], complexity (0-10) [libopus default], vbr [true],
+// cvbr [false], frameDuration (2.5-60 ms) [60] and application
+// ('voip' | 'audio' | 'restricted-lowdelay') ['audio']. Lower complexity
+// trades quality for encode speed, which suits bulk archival.
+//
+// sampleRate may be any whole rate from 8000 to 192000 Hz. Opus codes at
+// 8000, 12000, 16000, 24000 or 48000; normalize() decodes and encodes at the
+// next of those up, while PCM written at other rates through an OpusWriter
+// (which takes the same options) is resampled to it by a polyphase filter.
+//
+// options.maxDelay (ms, default 0) is how much audio may be packed into one
+// Ogg page before it is flushed. 0 suits live use; batch jobs can raise it
+// towards 1000 to cut per-page container overhead. options.flushThreshold
+// (bytes, default 65536) is how much output is gathered before it is written
+// out in one writev(); 0 writes every page as soon as it is complete.
+//
+// options.mode is 'transcode' (the default), 'remux' or 'auto'. 'remux'
+// copies the Opus packets of an Ogg Opus input into a new stream without
+// decoding them, rewriting only the headers and granule positions. 'auto'
+// remuxes single-link inputs whose channels and original sample rate match
+// the options and whose bitrate is no more than a quarter over the target,
+// and transcodes everything else. 'gain' sets the output gain in the
+// OpusHead of an Ogg Opus input to options.gain (dB, default 0), which
+// players apply on decode; the audio is copied as it is, and passing the
+// same path as input and output patches the file in place.
+OpusFile.normalize = function(input, output, options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+
+  return promisify(function(done) {
+    OpusFile.NormalizeAsync(input, output, options || {}, done);
+  }, callback);
+};
+
+// Normalizes [{in, out}, ...] on a pool of `options.concurrency` native
+// threads (default: one per CPU). Resolves with one {in, out, frames, error}
+// entry per job; a failing file does not fail the batch. Output pages are
+// packed up to options.maxDelay (default 1000 ms) since nothing is waiting
+// on them.
+OpusFile.normalizeBatch = function(jobs, options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  options = Object.assign({ maxDelay: 1000 }, options);
+  var concurrency = options.concurrency || os.cpus().length;
+
+  return promisify(function(done) {
+    OpusFile.NormalizeBatch(jobs, concurrency, options, done);
+  }, callback);
+};
+
+// OpusFile.OpusDecoder(path) exposes opusfile directly. It also accepts a
+// Buffer, typed array or ArrayBuffer holding a whole Ogg Opus file, which is
+// decoded in place and referenced, not copied, until close(). readInto(pcm)
+// decodes the next packet into an Int16Array or Float32Array and returns
+// {samples, link}, samples being per channel and 0 at the end of the file.
+// pcmSeek(), pcmTell(), pcmTotal([link]) and channelCount([link]) work in
+// samples at the decode rate, and close() releases the file.
+//
+// A path is decoded from a memory mapping of the file where the platform
+// allows it. Truncating the file while the decoder is open then kills the
+// process with SIGBUS rather than failing the read, so copy files that other
+// processes may rewrite, or pass them as a Buffer. normalize(), probe() and
+// probeMany() read through stdio and are not affected.
+//
+// new OpusDecoder(path, {rate: 16000}) decodes at 8000, 12000, 16000 or
+// 24000 Hz instead of 48000, which is cheaper than resampling afterwards;
+// the seek index interval stays in 48 kHz samples.
+//
+// new OpusDecoder(path, {dither: false}) rounds Int16Array reads without
+// dither, and {stereo: true} makes readInto() and read() downmix or duplicate
+// every link to two interleaved channels. The dither, rounding and downmix run on
+// SSE2 or AVX2 where the CPU has them, with the same output as the C code;
+// the environment variable OPUSFILE_SIMD ('none', 'sse2') caps the kernels,
+// and bench/pcm.js compares them.
+//
+// Building with `node-gyp rebuild -- -Dopusfile_fixed_point=1` makes libopus
+// decode straight to 16 bits, which speeds up Int16Array reads; Float32Array
+// reads then carry 16-bit precision and {dither} has no effect.
+// OpusFile.fixedPoint tells the builds apart, and bench/fixed-point.js
+// compares them.
+//
+// buildSeekIndex([interval]) reads the file once and records one page per
+// interval samples (default 48000), after which pcmSeek() reads a page or
+// two instead of bisecting the file. saveSeekIndex() returns the index as a
+// Buffer to store as a sidecar; pass it back as options.seekIndex when the
+// file is next opened. An index that no longer matches the file is refused.
+//
+// new OpusDecoder(path, {prefetch: K, prefetchSamples: N}) decodes up to K
+// buffers of N samples per channel (default 11520) ahead on a native
+// thread. read() then returns the next one as {pcm, samples, link} without
+// decoding, or null at the end; pcm is only valid until the next read(),
+// pcmSeek() or close().
+//
+// With {lazy: true} the decoder is ready as soon as the first link's headers
+// are read. The rest of a chained file is only scanned for its links when
+// pcmTotal(), a seek or playback reaching the second link needs them.
+
+// Returns a Duplex stream that takes Ogg Opus bytes, from a Readable or a
+// socket, and emits 16-bit PCM Buffers as soon as each packet is decoded.
+// Every stream decodes on a thread of its own, so any number of them can
+// wait for input without tying up the libuv threadpool. The input need not
+// be seekable. A 'format' event with {link, channels} precedes the PCM of
+// every new link. Input is buffered natively up to options.bufferSize bytes
+// (default 262144); beyond that writes are held back until the decoder
+// catches up. Decoding pauses while the readable side is full and resumes
+// when it is read.
+OpusFile.createDecodeStream = function(options) {
+  options = options || {};
+  var pending = null;
+  var pendingCallback = null;
+  var format = null;
+  var done = false;
+
+  var duplex = new stream.Duplex({
+    write: function(chunk, encoding, callback) {
+      pending = chunk;
+      pendingCallback = callback;
+      offer();
+    },
+    final: function(callback) {
+      decoder.end();
+      callback();
+    },
+    read: function() {
+      decoder.resume();
+    },
+    destroy: function(err, callback) {
+      decoder.abort();
+      callback(err);
+    }
+  });
+
+  function offer() {
+    if (!pending) {
+      return;
+    }
+    var taken = done ? pending.length : decoder.push(pending);
+    if (taken < pending.length) {
+      pending = pending.slice(taken);
+      return;
+    }
+    var callback = pendingCallback;
+    pending = null;
+    pendingCallback = null;
+    callback();
+  }
+
+  var decoder = new OpusFile.StreamDecoder(function(pcm, link, channels) {
+    if (!format || format.link !== link) {
+      format = { link: link, channels: channels };
+      duplex.emit('format', format);
+    }
+    if (!duplex.push(pcm)) {
+      decoder.pause();
+    }
+  }, offer, function(err) {
+    done = true;
+    if (err) {
+      duplex.destroy(err);
+      return;
+    }
+    // Anything after the end of the Opus stream is dropped.
+    offer();
+    // All of the PCM has been delivered before this.
+    duplex.push(null);
+  }, options.bufferSize);
+
+  return duplex;
+};
+
+// Returns {duration, links, channels, inputSampleRate, outputGain, preSkip,
+// mappingFamily, bitrate, vendor, tags} for an Ogg Opus file. duration is in
+// 48 kHz samples per channel over all links, outputGain in dB, and tags an
+// array of 'NAME=value' strings; the header fields describe the first link.
+// Results are kept in an LRU cache keyed by path, and a repeat probe of a
+// file whose size and modification time are unchanged costs one stat and
+// answers without leaving the JS thread. Anything else opens the file on the
+// libuv threadpool. Calls back with (err, info) when a callback is given,
+// otherwise returns a Promise for it.
+OpusFile.probe = function(path, callback) {
+  return promisify(function(done) {
+    var cached = OpusFile.ProbeCached(path);
+    if (cached) {
+      process.nextTick(done, null, cached);
+      return;
+    }
+    OpusFile.ProbeAsync(path, done);
+  }, callback);
+};
+
+// The probe cache. save(path) writes it to disk and load(path) reads it
+// back, e.g. across restarts; loaded entries are checked against their files
+// when next probed. setCapacity(n) bounds it (default 4096 entries), and
+// stats() returns {entries, capacity, hits, misses}.
+OpusFile.probeCache = {
+  save: function(path) { OpusFile.ProbeCacheSave(path); },
+  load: function(path) { return OpusFile.ProbeCacheLoad(path); },
+  setCapacity: function(capacity) { OpusFile.ProbeCacheSetCapacity(capacity); },
+  clear: function() { OpusFile.ProbeCacheClear(); },
+  stats: function() { return OpusFile.ProbeCacheStats(); }
+};
+
+// Checks many files for Ogg Opus at once on `options.concurrency` native
+// threads (default: one per CPU), reading only their first pages. With
+// options.duration it also reads each file's last page for its duration.
+// Resolves with typed arrays indexed like paths: status (0 for Ogg Opus,
+// otherwise a negative opusfile error code), channels, and duration (48 kHz
+// samples per channel, or -1). Chained files report a duration of -1; use
+// probe() for those.
+OpusFile.probeMany = function(paths, options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  options = options || {};
+  var concurrency = options.concurrency || os.cpus().length;
+
+  return promisify(function(done) {
+    OpusFile.ProbeBatch(paths, concurrency, !!options.duration, done);
+  }, callback);
+};
+
 module.exports = OpusFile;
@@ -0,0 +1,15 @@
+#include "alloc_count.h"
+
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#endif
+
+long long threadAllocations() {
+#if defined(_WIN32)
+  return -1;
+#else
+  typedef unsigned long long (*Counter)(void);
+  static Counter counter = reinterpret_cast<Counter>(dlsym(RTLD_DEFAULT, "opusfile_thread_allocations"));
+  return counter ? (long long)counter() : -1;
+#endif
+}
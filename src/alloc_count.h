@@ -0,0 +1,11 @@
+#if !defined( ALLOC_COUNT_H )
+#define ALLOC_COUNT_H
+
+/* Heap allocations made so far on the calling thread, through malloc and
+   friends or operator new, including those inside libopus and libogg. Only
+   counted when the process runs with the counting allocator from
+   test/alloc_counter.cc preloaded (see the alloc_counter target); -1
+   otherwise. */
+long long threadAllocations();
+
+#endif
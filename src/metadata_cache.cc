@@ -0,0 +1,333 @@
+#include "metadata_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Saved cache layout, all integers little-endian:
+   "OpusMdC1", u32 count, then count entries from least to most recently
+   used: str path, i64 size, i64 mtime, i64 duration, i32 links, channels,
+   input_sample_rate, output_gain, pre_skip, mapping_family, bitrate,
+   str vendor, u32 comment count, str comments..., where str is a u32
+   length followed by that many bytes. */
+#define CACHE_MAGIC "OpusMdC1"
+
+static void putU32(std::string *out, opus_uint32 value) {
+  for (int i = 0; i < 4; i++) {
+    out->push_back((char)(value >> (8 * i) & 0xFF));
+  }
+}
+
+static void putI64(std::string *out, long long value) {
+  unsigned long long bits = (unsigned long long)value;
+  for (int i = 0; i < 8; i++) {
+    out->push_back((char)(bits >> (8 * i) & 0xFF));
+  }
+}
+
+static void putString(std::string *out, const std::string &value) {
+  putU32(out, (opus_uint32)value.size());
+  out->append(value);
+}
+
+/* Reads a saved cache, failing once on the first short or bad field. */
+class CacheReader {
+ public:
+  CacheReader(const unsigned char *data, size_t size) : data(data), size(size), pos(0), ok(true) {}
+
+  bool good() const { return ok; }
+
+  opus_uint32 u32() {
+    if (!need(4)) {
+      return 0;
+    }
+    opus_uint32 value = 0;
+    for (int i = 0; i < 4; i++) {
+      value |= (opus_uint32)data[pos++] << (8 * i);
+    }
+    return value;
+  }
+
+  long long i64() {
+    if (!need(8)) {
+      return 0;
+    }
+    unsigned long long bits = 0;
+    for (int i = 0; i < 8; i++) {
+      bits |= (unsigned long long)data[pos++] << (8 * i);
+    }
+    return (long long)bits;
+  }
+
+  std::string string() {
+    opus_uint32 length = u32();
+    if (!need(length)) {
+      return std::string();
+    }
+    std::string value(reinterpret_cast<const char *>(data + pos), length);
+    pos += length;
+    return value;
+  }
+
+ private:
+  bool need(size_t bytes) {
+    if (ok && size - pos < bytes) {
+      ok = false;
+    }
+    return ok;
+  }
+
+  const unsigned char *data;
+  size_t size;
+  size_t pos;
+  bool ok;
+};
+
+/* Size and modification time of path, or -1 when it cannot be stat'ed. */
+static int statFile(const char *path, long long *size, long long *mtime) {
+  uv_fs_t req;
+  int res = uv_fs_stat(NULL, &req, path, NULL);
+  if (res == 0) {
+    *size = (long long)req.statbuf.st_size;
+    *mtime = (long long)req.statbuf.st_mtim.tv_sec * 1000000000LL + req.statbuf.st_mtim.tv_nsec;
+  }
+  uv_fs_req_cleanup(&req);
+  return res == 0 ? 0 : -1;
+}
+
+static int readMetadata(const char *path, FileMetadata *metadata) {
+  int error = 0;
+  /* Through stdio rather than a mapping, which would fault if another
+     process truncated the file while it was read. */
+  OggOpusFile *of = op_open_file(path, &error);
+  if (of == NULL) {
+    return error;
+  }
+
+  const OpusHead *head = op_head(of, 0);
+  metadata->duration = op_pcm_total(of, -1);
+  metadata->links = op_link_count(of);
+  metadata->channels = head->channel_count;
+  metadata->input_sample_rate = head->input_sample_rate;
+  metadata->output_gain = head->output_gain;
+  metadata->pre_skip = (int)head->pre_skip;
+  metadata->mapping_family = head->mapping_family;
+  metadata->bitrate = op_bitrate(of, -1);
+
+  const OpusTags *tags = op_tags(of, 0);
+  metadata->vendor = tags->vendor ? tags->vendor : "";
+  metadata->comments.clear();
+  for (int i = 0; i < tags->comments; i++) {
+    metadata->comments.push_back(std::string(tags->user_comments[i], tags->comment_lengths[i]));
+  }
+
+  op_free(of);
+  return 0;
+}
+
+MetadataCache::MetadataCache(size_t capacity) : limit(capacity), hit_count(0), miss_count(0) {
+  uv_mutex_init(&lock);
+}
+
+MetadataCache::~MetadataCache() {
+  uv_mutex_destroy(&lock);
+}
+
+int MetadataCache::find(const char *path, Entry *entry, FileMetadata *metadata, bool countMiss) {
+  if (statFile(path, &entry->size, &entry->mtime) < 0) {
+    return OP_EREAD;
+  }
+
+  uv_mutex_lock(&lock);
+  std::unordered_map<std::string, EntryList::iterator>::iterator it = index.find(path);
+  if (it != index.end() && it->second->size == entry->size && it->second->mtime == entry->mtime) {
+    entries.splice(entries.begin(), entries, it->second);
+    *metadata = it->second->metadata;
+    hit_count++;
+    uv_mutex_unlock(&lock);
+    return 1;
+  }
+  if (countMiss) {
+    miss_count++;
+  }
+  uv_mutex_unlock(&lock);
+  return 0;
+}
+
+int MetadataCache::lookup(const char *path, FileMetadata *metadata) {
+  Entry entry;
+  return find(path, &entry, metadata, false);
+}
+
+int MetadataCache::probe(const char *path, FileMetadata *metadata) {
+  Entry entry;
+  int res = find(path, &entry, metadata, true);
+  if (res != 0) {
+    return res < 0 ? res : 0;
+  }
+
+  /* Opened without the lock, so one slow file does not hold up hits. */
+  res = readMetadata(path, &entry.metadata);
+  if (res < 0) {
+    return res;
+  }
+  entry.path = path;
+  *metadata = entry.metadata;
+
+  uv_mutex_lock(&lock);
+  store(entry);
+  uv_mutex_unlock(&lock);
+  return 0;
+}
+
+void MetadataCache::store(const Entry &entry) {
+  std::unordered_map<std::string, EntryList::iterator>::iterator it = index.find(entry.path);
+  if (it != index.end()) {
+    entries.erase(it->second);
+  }
+  entries.push_front(entry);
+  index[entry.path] = entries.begin();
+  trim();
+}
+
+void MetadataCache::trim() {
+  while (entries.size() > limit) {
+    index.erase(entries.back().path);
+    entries.pop_back();
+  }
+}
+
+int MetadataCache::save(const char *path) {
+  std::string out(CACHE_MAGIC);
+
+  uv_mutex_lock(&lock);
+  putU32(&out, (opus_uint32)entries.size());
+  for (EntryList::reverse_iterator it = entries.rbegin(); it != entries.rend(); ++it) {
+    const FileMetadata &metadata = it->metadata;
+    putString(&out, it->path);
+    putI64(&out, it->size);
+    putI64(&out, it->mtime);
+    putI64(&out, metadata.duration);
+    putU32(&out, (opus_uint32)metadata.links);
+    putU32(&out, (opus_uint32)metadata.channels);
+    putU32(&out, metadata.input_sample_rate);
+    putU32(&out, (opus_uint32)metadata.output_gain);
+    putU32(&out, (opus_uint32)metadata.pre_skip);
+    putU32(&out, (opus_uint32)metadata.mapping_family);
+    putU32(&out, (opus_uint32)metadata.bitrate);
+    putString(&out, metadata.vendor);
+    putU32(&out, (opus_uint32)metadata.comments.size());
+    for (size_t i = 0; i < metadata.comments.size(); i++) {
+      putString(&out, metadata.comments[i]);
+    }
+  }
+  uv_mutex_unlock(&lock);
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return OP_EREAD;
+  }
+  size_t written = fwrite(out.data(), 1, out.size(), file);
+  if (fclose(file) != 0 || written != out.size()) {
+    return OP_EREAD;
+  }
+  return 0;
+}
+
+int MetadataCache::load(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return OP_EREAD;
+  }
+  std::vector<unsigned char> data;
+  unsigned char chunk[65536];
+  size_t bytes;
+  while ((bytes = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + bytes);
+  }
+  bool failed = ferror(file) != 0;
+  fclose(file);
+  if (failed) {
+    return OP_EREAD;
+  }
+
+  if (data.size() < 8 || memcmp(&data[0], CACHE_MAGIC, 8) != 0) {
+    return OP_EBADHEADER;
+  }
+  CacheReader reader(&data[8], data.size() - 8);
+  opus_uint32 count = reader.u32();
+  std::vector<Entry> loaded;
+  for (opus_uint32 i = 0; i < count && reader.good(); i++) {
+    Entry entry;
+    FileMetadata &metadata = entry.metadata;
+    entry.path = reader.string();
+    entry.size = reader.i64();
+    entry.mtime = reader.i64();
+    metadata.duration = reader.i64();
+    metadata.links = (int)reader.u32();
+    metadata.channels = (int)reader.u32();
+    metadata.input_sample_rate = reader.u32();
+    metadata.output_gain = (int)reader.u32();
+    metadata.pre_skip = (int)reader.u32();
+    metadata.mapping_family = (int)reader.u32();
+    metadata.bitrate = (opus_int32)reader.u32();
+    metadata.vendor = reader.string();
+    opus_uint32 comments = reader.u32();
+    for (opus_uint32 c = 0; c < comments && reader.good(); c++) {
+      metadata.comments.push_back(reader.string());
+    }
+    loaded.push_back(entry);
+  }
+  if (!reader.good()) {
+    return OP_EBADHEADER;
+  }
+
+  uv_mutex_lock(&lock);
+  for (size_t i = 0; i < loaded.size(); i++) {
+    store(loaded[i]);
+  }
+  uv_mutex_unlock(&lock);
+  return (int)loaded.size();
+}
+
+void MetadataCache::setCapacity(size_t capacity) {
+  uv_mutex_lock(&lock);
+  limit = capacity;
+  trim();
+  uv_mutex_unlock(&lock);
+}
+
+void MetadataCache::clear() {
+  uv_mutex_lock(&lock);
+  entries.clear();
+  index.clear();
+  hit_count = 0;
+  miss_count = 0;
+  uv_mutex_unlock(&lock);
+}
+
+size_t MetadataCache::capacity() {
+  uv_mutex_lock(&lock);
+  size_t value = limit;
+  uv_mutex_unlock(&lock);
+  return value;
+}
+
+size_t MetadataCache::size() {
+  uv_mutex_lock(&lock);
+  size_t value = entries.size();
+  uv_mutex_unlock(&lock);
+  return value;
+}
+
+long long MetadataCache::hits() {
+  uv_mutex_lock(&lock);
+  long long value = hit_count;
+  uv_mutex_unlock(&lock);
+  return value;
+}
+
+long long MetadataCache::misses() {
+  uv_mutex_lock(&lock);
+  long long value = miss_count;
+  uv_mutex_unlock(&lock);
+  return value;
+}
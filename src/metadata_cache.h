@@ -0,0 +1,93 @@
+#if !defined( METADATA_CACHE_H )
+#define METADATA_CACHE_H
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <uv.h>
+#include "../deps/opusfile/include/opusfile.h"
+
+/* What probe() reports about an Ogg Opus file. Header fields come from the
+   first link. */
+struct FileMetadata {
+  FileMetadata()
+    : duration(0), links(0), channels(0), input_sample_rate(0), output_gain(0), pre_skip(0),
+      mapping_family(0), bitrate(0) {}
+
+  /* Samples per channel at 48 kHz, over all links. */
+  ogg_int64_t duration;
+  int links;
+  int channels;
+  opus_uint32 input_sample_rate;
+  /* Q7.8 dB, as stored in the OpusHead. */
+  int output_gain;
+  int pre_skip;
+  int mapping_family;
+  opus_int32 bitrate;
+  std::string vendor;
+  /* "TAG=value" comments, in file order. */
+  std::vector<std::string> comments;
+};
+
+/* LRU cache of FileMetadata keyed by path. An entry is only used while the
+   file's size and modification time still match, so a hit costs a stat.
+   Safe to share between threads. */
+class MetadataCache {
+ public:
+  explicit MetadataCache(size_t capacity = 4096);
+  ~MetadataCache();
+
+  /* Fills *metadata for path, opening the file only on a miss. Returns 0,
+     OP_EREAD if the file cannot be stat'ed, or the opusfile open error. */
+  int probe(const char *path, FileMetadata *metadata);
+  /* Like probe() but never opens the file: returns 1 and fills *metadata on
+     a hit, 0 on a miss (not counted, since probe() will follow), or
+     OP_EREAD. */
+  int lookup(const char *path, FileMetadata *metadata);
+
+  /* Writes every entry to a file that load() can read back. Returns 0 or
+     OP_EREAD. */
+  int save(const char *path);
+  /* Adds the entries saved in path, most recent last. Entries are checked
+     against the files when they are next probed. Returns the number read,
+     OP_EREAD, or OP_EBADHEADER for a file that is not a saved cache. */
+  int load(const char *path);
+
+  void setCapacity(size_t capacity);
+  void clear();
+
+  size_t capacity();
+  size_t size();
+  long long hits();
+  long long misses();
+
+ private:
+  MetadataCache(const MetadataCache&);
+  MetadataCache& operator=(const MetadataCache&);
+
+  struct Entry {
+    std::string path;
+    long long size;
+    /* Nanoseconds since the epoch. */
+    long long mtime;
+    FileMetadata metadata;
+  };
+  typedef std::list<Entry> EntryList;
+
+  /* Stats path into *entry and copies a matching entry to *metadata. */
+  int find(const char *path, Entry *entry, FileMetadata *metadata, bool countMiss);
+  /* Inserts or refreshes an entry as the most recently used. Needs lock. */
+  void store(const Entry &entry);
+  void trim();
+
+  uv_mutex_t lock;
+  size_t limit;
+  /* Most recently used first. */
+  EntryList entries;
+  std::unordered_map<std::string, EntryList::iterator> index;
+  long long hit_count;
+  long long miss_count;
+};
+
+#endif
@@ -0,0 +1,638 @@
+#include "normalizer.h"
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include "../deps/opusfile/include/opusfile.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <stdlib.h>
+#else
+#include <unistd.h>
+#endif
+
+#define ENCODER_SIZE 133
+/* One decoded input packet: up to 120 ms of stereo at 48 kHz. */
+#define MAX_DECODE_SAMPLES (5760 * 2)
+/* Input read per ogg_sync_buffer call while remuxing. */
+#define REMUX_READ_SIZE 4096
+
+Normalizer::Normalizer()
+  : decoder(0), decoder_rate(0), decoder_channels(0), frame_samples(0), pending(0), frames(0) {
+  ogg_sync_init(&oy);
+  ogg_stream_init(&is, 0);
+}
+
+Normalizer::~Normalizer() {
+  if (decoder) {
+    opus_decoder_destroy(decoder);
+    decoder = 0;
+  }
+  ogg_sync_clear(&oy);
+  ogg_stream_clear(&is);
+}
+
+/* Accounts for `samples` new values appended to pcm and encodes every whole
+   frame that is now available. Returns 0 if writing failed. */
+int Normalizer::queue(int samples) {
+  pending += samples;
+
+  int consumed = 0;
+  while (pending - consumed >= frame_samples) {
+    if (!recorder.writeFrame((uint8_t *)(pcm + consumed), frame_samples * 2)) {
+      return 0;
+    }
+    consumed += frame_samples;
+    frames++;
+  }
+
+  memmove(pcm, pcm + consumed, (pending - consumed) * sizeof(opus_int16));
+  pending -= consumed;
+  return 1;
+}
+
+/* Encodes what is left as a short last frame, which the recorder pads and
+   marks as the end of the stream. Input that ends on a whole frame leaves
+   nothing here; Recorder::finish() then ends the stream itself. */
+int Normalizer::drain() {
+  if (pending > 0) {
+    if (!recorder.writeFrame((uint8_t *)pcm, pending * 2)) {
+      return 0;
+    }
+    pending = 0;
+    frames++;
+  }
+  return 1;
+}
+
+/* Raw input: a sequence of fixed ENCODER_SIZE-byte CBR Opus packets. */
+const char *Normalizer::readRaw(FILE *fin, const RecorderOptions &options) {
+  unsigned char bytes[ENCODER_SIZE];
+  int error = OPUS_OK;
+  int res = 0;
+
+  /* Decode straight to the encoder's rate and channel count. */
+  if (decoder && (decoder_rate != options.rate || decoder_channels != options.channels)) {
+    opus_decoder_destroy(decoder);
+    decoder = 0;
+  }
+  if (decoder) {
+    error = opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+  } else {
+    decoder = opus_decoder_create(options.rate, options.channels, &error);
+    decoder_rate = options.rate;
+    decoder_channels = options.channels;
+  }
+  if (error != OPUS_OK) {
+    fprintf(stderr, "\nerror: %s", opus_strerror(error));
+    return opus_strerror(error);
+  }
+
+  while (!feof(fin)) {
+    size_t stfrd = fread(bytes, sizeof(unsigned char), ENCODER_SIZE, fin);
+    res = opus_decode(decoder, bytes, ENCODER_SIZE, pcm + pending, MAX_DECODE_SAMPLES / options.channels, 0);
+    if (res < 0) {
+      fprintf(stderr, "\nstfrd: %zu res: %d decoder: %s", stfrd, res, opus_strerror(res));
+      continue;
+    }
+    if (!queue(res * options.channels)) {
+      return "failed writing frame to output file";
+    }
+  }
+
+  return NULL;
+}
+
+/* Ogg Opus input, demuxed and decoded by opusfile. It applies pre-skip and
+   end trimming, so exactly the encoded duration comes out. */
+const char *Normalizer::readOgg(OggOpusFile *of, int channels) {
+  /* Mono output can read mono links directly; anything else goes through
+     the stereo API, which also folds surround links down to two channels. */
+  int direct = channels == 1;
+  for (int li = 0; direct && li < op_link_count(of); li++) {
+    direct = op_channel_count(of, li) == 1;
+  }
+
+  for (;;) {
+    int res;
+    if (direct) {
+      res = op_read(of, pcm + pending, MAX_DECODE_SAMPLES, NULL);
+    } else if (channels == 2) {
+      res = op_read_stereo(of, pcm + pending, MAX_DECODE_SAMPLES);
+    } else {
+      res = op_read_stereo(of, stereo, MAX_DECODE_SAMPLES);
+      for (int i = 0; i < res; i++) {
+        pcm[pending + i] = (opus_int16)((stereo[2 * i] + stereo[2 * i + 1]) / 2);
+      }
+    }
+
+    if (res == OP_HOLE) {
+      continue;
+    }
+    if (res < 0) {
+      fprintf(stderr, "\nop_read failed: %d", res);
+      return "failed decoding input file";
+    }
+    if (res == 0) {
+      break;
+    }
+    if (!queue(res * channels)) {
+      return "failed writing frame to output file";
+    }
+  }
+
+  return NULL;
+}
+
+/* Ogg Opus input copied packet for packet into a fresh stream. Only the
+   OpusHead/OpusTags and granule positions are rewritten: the output starts
+   at granule 0 and keeps the source's pre-skip, gain and start and end
+   trimming. */
+const char *Normalizer::remux(FILE *fin, const char *outPath, const RecorderOptions &options) {
+  ogg_page page;
+  ogg_packet packet;
+  int serialno = -1;
+  int headers = 0;
+  int eos = 0;
+  /* Samples in the packets read so far, and the source granule position that
+     corresponds to zero. */
+  ogg_int64_t total = 0;
+  ogg_int64_t offset = 0;
+  int have_offset = 0;
+  ogg_int64_t last_granulepos = -1;
+  int held_duration = 0;
+  int have_held = 0;
+  OpusHeader header;
+  const char *message;
+
+  ogg_sync_reset(&oy);
+  lead.clear();
+  lead_packets.clear();
+  frames = 0;
+
+  /* Reads to the end of the file even after EOS so that a chained link is
+     reported rather than silently dropped. */
+  for (;;) {
+    int got = ogg_sync_pageout(&oy, &page);
+    if (got < 0) {
+      continue;
+    }
+    if (got == 0) {
+      char *buffer = ogg_sync_buffer(&oy, REMUX_READ_SIZE);
+      size_t bytes = fread(buffer, 1, REMUX_READ_SIZE, fin);
+      if (bytes == 0) {
+        break;
+      }
+      ogg_sync_wrote(&oy, bytes);
+      continue;
+    }
+
+    if (ogg_page_bos(&page)) {
+      if (serialno != -1) {
+        if (headers == 2 || eos) {
+          return "chained input cannot be remuxed";
+        }
+        continue;
+      }
+      ogg_stream_reset_serialno(&is, ogg_page_serialno(&page));
+      ogg_stream_pagein(&is, &page);
+      if (ogg_stream_packetout(&is, &packet) != 1) {
+        continue;
+      }
+
+      OpusHead head;
+      if (opus_head_parse(&head, packet.packet, packet.bytes) < 0) {
+        /* Some other codec multiplexed into the file. */
+        continue;
+      }
+
+      memset(&header, 0, sizeof(header));
+      header.version = 1;
+      header.channels = head.channel_count;
+      header.preskip = head.pre_skip;
+      header.input_sample_rate = head.input_sample_rate;
+      header.gain = head.output_gain;
+      header.channel_mapping = head.mapping_family;
+      header.nb_streams = head.stream_count;
+      header.nb_coupled = head.coupled_count;
+      memcpy(header.stream_map, head.mapping, sizeof(header.stream_map));
+      serialno = ogg_page_serialno(&page);
+      headers = 1;
+      continue;
+    }
+
+    if (ogg_page_serialno(&page) != serialno || eos) {
+      continue;
+    }
+
+    ogg_stream_pagein(&is, &page);
+    eos = ogg_page_eos(&page);
+
+    int got_packet;
+    while ((got_packet = ogg_stream_packetout(&is, &packet)) != 0) {
+      if (got_packet < 0) {
+        continue;
+      }
+      if (headers == 1) {
+        /* The source OpusTags; ours were written by initPassthrough. */
+        headers = 2;
+        continue;
+      }
+
+      int duration = opus_packet_get_nb_samples(packet.packet, packet.bytes, 48000);
+      if (duration < 0) {
+        return "invalid Opus packet in input file";
+      }
+
+      if (!have_offset) {
+        /* Not written until the first granule position is known. */
+        lead.insert(lead.end(), packet.packet, packet.packet + packet.bytes);
+        lead_packets.push_back(packet.bytes);
+        lead_packets.push_back(duration);
+        total += duration;
+        continue;
+      }
+      if (have_held) {
+        if (!recorder.writePacket(&held[0], held.size(), held_duration, total, 0)) {
+          return "failed writing frame to output file";
+        }
+        frames++;
+      }
+      held.assign(packet.packet, packet.packet + packet.bytes);
+      held_duration = duration;
+      have_held = 1;
+      total += duration;
+    }
+
+    ogg_int64_t granulepos = ogg_page_granulepos(&page);
+    if (granulepos != -1 && headers == 2) {
+      if (!have_offset && !lead_packets.empty()) {
+        /* A stream may start at a non-zero time. The last page is the one
+           place where the granule may fall short of the samples for end
+           trimming; anywhere else it asks for the start to be trimmed
+           (RFC 7845, section 4.4), which the output gets as extra pre-skip
+           since its granule positions start at 0. */
+        offset = eos ? 0 : granulepos - total;
+        if (offset < 0) {
+          if (header.preskip - offset > 65535) {
+            return "start trimming in input file is too long";
+          }
+          header.preskip -= (int)offset;
+        }
+        if ((message = startRemux(outPath, options, header, &held_duration)) != NULL) {
+          return message;
+        }
+        have_offset = 1;
+        have_held = !lead_packets.empty();
+      }
+      last_granulepos = granulepos;
+    }
+  }
+
+  if (serialno == -1) {
+    return "no Opus stream in input file";
+  }
+  if (!have_offset) {
+    /* No audio page carried a granule position. */
+    if ((message = startRemux(outPath, options, header, &held_duration)) != NULL) {
+      return message;
+    }
+    have_held = !lead_packets.empty();
+  }
+
+  if (have_held) {
+    /* End trimming: the source's final granule may cut the last packet. */
+    ogg_int64_t end = total;
+    if (last_granulepos != -1 && last_granulepos - offset < end) {
+      end = last_granulepos - offset;
+      if (end < total - held_duration) {
+        end = total - held_duration;
+      }
+    }
+    if (!recorder.writePacket(&held[0], held.size(), held_duration, end, 1)) {
+      return "failed writing frame to output file";
+    }
+    frames++;
+  }
+
+  return NULL;
+}
+
+/* Opens the remux output with header and writes the packets read before the
+   start offset was known, all but the last, which is left in held. */
+const char *Normalizer::startRemux(const char *outPath, const RecorderOptions &options,
+                                   const OpusHeader &header, int *held_duration) {
+  if (recorder.initPassthrough(outPath, options, header) != 1) {
+    return "failed to open output file";
+  }
+
+  ogg_int64_t granulepos = 0;
+  size_t start = 0;
+  for (size_t i = 0; i < lead_packets.size(); i += 2) {
+    int bytes = lead_packets[i];
+    int duration = lead_packets[i + 1];
+    granulepos += duration;
+    if (i + 2 == lead_packets.size()) {
+      held.assign(lead.begin() + start, lead.begin() + start + bytes);
+      *held_duration = duration;
+    } else {
+      if (!recorder.writePacket(&lead[start], bytes, duration, granulepos, 0)) {
+        return "failed writing frame to output file";
+      }
+      frames++;
+    }
+    start += bytes;
+  }
+  return NULL;
+}
+
+/* Whether outPath is the file open as fin, however either path is spelled
+   or linked. */
+static int sameFile(FILE *fin, const char *inPath, const char *outPath) {
+#if defined(_WIN32)
+  /* st_ino is always 0 here, so compare the full paths instead. */
+  char in[_MAX_PATH];
+  char out[_MAX_PATH];
+  (void)fin;
+  return _fullpath(in, inPath, sizeof(in)) && _fullpath(out, outPath, sizeof(out)) && _stricmp(in, out) == 0;
+#else
+  struct stat a;
+  struct stat b;
+  (void)inPath;
+  return fstat(fileno(fin), &a) == 0 && stat(outPath, &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+#endif
+}
+
+/* Creates a new file next to path, to be renamed over it once complete, and
+   puts its name in *tmp. An existing path keeps its permissions. */
+static FILE *openBeside(const char *path, std::string *tmp) {
+  *tmp = std::string(path) + ".XXXXXX";
+#if defined(_WIN32)
+  if (_mktemp_s(&(*tmp)[0], tmp->size() + 1) != 0) {
+    return NULL;
+  }
+  return fopen(tmp->c_str(), "wb");
+#else
+  int fd = mkstemp(&(*tmp)[0]);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  fchmod(fd, stat(path, &st) == 0 ? st.st_mode & 07777 : 0644);
+  FILE *file = fdopen(fd, "wb");
+  if (file == NULL) {
+    close(fd);
+    unlink(tmp->c_str());
+  }
+  return file;
+#endif
+}
+
+/* Sets the output gain of an Ogg Opus file. Only the OpusHead in the first
+   page changes, so the page CRC is recomputed and everything after it is
+   copied byte for byte; when outPath is the input file the page is patched
+   in place and nothing else is touched. Otherwise the copy goes to a new
+   file that replaces outPath only once it is complete. opusfile applies the
+   gain when decoding. */
+const char *Normalizer::rewriteGain(FILE *fin, const char *inPath, const char *outPath, int gain,
+                                    NormalizeStats *stats) {
+  int inPlace = sameFile(fin, inPath, outPath);
+  std::string tmpPath;
+  /* The largest possible Ogg page. */
+  held.resize(27 + 255 + 255 * 255);
+  unsigned char *data = &held[0];
+
+  ogg_page page;
+  page.header = data;
+  page.header_len = 27;
+  if (fread(data, 1, 27, fin) != 27 || memcmp(data, "OggS", 4) != 0 || !(data[5] & 0x02)) {
+    fclose(fin);
+    return "input file does not start with an Ogg page";
+  }
+  page.header_len += data[26];
+  if (fread(data + 27, 1, data[26], fin) != data[26]) {
+    fclose(fin);
+    return "input file does not start with an Ogg page";
+  }
+  page.body = data + page.header_len;
+  page.body_len = 0;
+  for (int i = 0; i < data[26]; i++) {
+    page.body_len += data[27 + i];
+  }
+  if (fread(page.body, 1, page.body_len, fin) != (size_t)page.body_len ||
+      page.body_len < 19 || memcmp(page.body, "OpusHead", 8) != 0) {
+    fclose(fin);
+    return "input file does not start with an OpusHead";
+  }
+
+  page.body[16] = (unsigned char)(gain & 0xFF);
+  page.body[17] = (unsigned char)((gain >> 8) & 0xFF);
+  ogg_page_checksum_set(&page);
+
+  FILE *fout;
+  if (inPlace) {
+    fclose(fin);
+    fin = NULL;
+    fout = fopen(outPath, "r+b");
+  } else {
+    fout = openBeside(outPath, &tmpPath);
+  }
+  if (fout == NULL) {
+    if (fin) {
+      fclose(fin);
+    }
+    fprintf(stderr, "\nfailed to open output file: %s", strerror(errno));
+    return "failed to open output file";
+  }
+
+  const char *message = NULL;
+  size_t pageBytes = page.header_len + page.body_len;
+  if (fwrite(data, 1, pageBytes, fout) != pageBytes) {
+    message = "failed writing data to output file";
+  }
+  stats->bytesWritten = pageBytes;
+  stats->pagesOut = 1;
+  stats->writeCalls = 1;
+
+  /* The rest of the file is copied through the page buffer. */
+  while (!message && fin) {
+    size_t bytes = fread(data, 1, held.size(), fin);
+    if (bytes == 0) {
+      break;
+    }
+    if (fwrite(data, 1, bytes, fout) != bytes) {
+      message = "failed writing data to output file";
+    }
+    stats->bytesWritten += bytes;
+    stats->writeCalls++;
+  }
+
+  if (fin) {
+    fclose(fin);
+  }
+  if (fclose(fout) != 0 && !message) {
+    message = "failed writing data to output file";
+  }
+  if (!inPlace) {
+#if defined(_WIN32)
+    /* rename() does not replace an existing file here. */
+    if (!message) {
+      remove(outPath);
+    }
+#endif
+    if (!message && rename(tmpPath.c_str(), outPath) != 0) {
+      fprintf(stderr, "\nfailed to replace output file: %s", strerror(errno));
+      message = "failed writing data to output file";
+    }
+    if (message) {
+      remove(tmpPath.c_str());
+    }
+  }
+  return message;
+}
+
+/* Whether an opened Ogg Opus file can be remuxed as it is and still meet
+   the encoder options. A lower bitrate is fine, since re-encoding could not
+   restore what is already gone; the 25% allowance covers Ogg overhead, which
+   op_bitrate counts in. */
+static int matchesOptions(OggOpusFile *of, const RecorderOptions &options) {
+  if (op_link_count(of) != 1) {
+    return 0;
+  }
+  const OpusHead *head = op_head(of, 0);
+  if (head->channel_count != options.channels || head->mapping_family != 0 ||
+      (opus_int32)head->input_sample_rate != options.rate) {
+    return 0;
+  }
+  opus_int32 bitrate = op_bitrate(of, -1);
+  return bitrate >= 0 && bitrate <= options.bitrate + options.bitrate / 4;
+}
+
+const char *Normalizer::run(const char *inPath, const char *outPath,
+                            const NormalizeOptions &options, NormalizeStats *stats) {
+  FILE *fin;
+  OggOpusFile *of = NULL;
+  unsigned char magic[4];
+  const char *message;
+
+  memset(stats, 0, sizeof(NormalizeStats));
+
+  fin = fopen(inPath, "rb");
+  if (fin == NULL) {
+    fprintf(stderr, "\nfailed to open input file: %s", strerror(errno));
+    return "failed to open input file";
+  }
+
+  /* Anything that starts with an Ogg capture pattern is handed to opusfile;
+     everything else is treated as raw packets. */
+  RecorderOptions recorderOptions = options.encoder;
+  int ogg = fread(magic, 1, sizeof(magic), fin) == sizeof(magic) && memcmp(magic, "OggS", 4) == 0;
+  rewind(fin);
+
+  if (!ogg && options.mode == NORMALIZE_REMUX) {
+    fclose(fin);
+    return "only Ogg Opus input can be remuxed";
+  }
+  if (options.mode == NORMALIZE_GAIN) {
+    if (!ogg) {
+      fclose(fin);
+      return "only Ogg Opus input can have its gain set";
+    }
+    return rewriteGain(fin, inPath, outPath, options.gain, stats);
+  }
+
+  int remuxing = ogg && options.mode == NORMALIZE_REMUX;
+  if (ogg && !remuxing) {
+    int error = OPUS_OK;
+    /* Not mapped: batch inputs may be truncated under us, which a mapping
+       would turn into SIGBUS instead of a read error. */
+    of = op_open_file(inPath, &error);
+    if (of == NULL) {
+      fclose(fin);
+      fprintf(stderr, "\nop_open_file failed: %d", error);
+      return "failed to open input file";
+    }
+
+    if (options.mode == NORMALIZE_AUTO && matchesOptions(of, recorderOptions)) {
+      op_free(of);
+      of = NULL;
+      remuxing = 1;
+    } else {
+      fclose(fin);
+      fin = NULL;
+    }
+  }
+
+  if (!remuxing) {
+    /* Decode straight to the encoder's rate, which skips the upper bands of
+       the synthesis instead of resampling afterwards. Opus decodes to any
+       rate it codes at, so a sampleRate in between is decoded and encoded
+       at the next one up rather than resampled at all. */
+    recorderOptions.rate = Recorder::codingRate(recorderOptions.rate);
+    if (of && op_set_decode_rate(of, recorderOptions.rate) < 0) {
+      recorderOptions.rate = 48000;
+    }
+  }
+
+  if (remuxing) {
+    message = remux(fin, outPath, recorderOptions);
+    fclose(fin);
+    if (!message && !recorder.finish()) {
+      message = "failed writing frame to output file";
+    }
+    return finishRun(message, stats);
+  }
+
+  if (recorder.init(outPath, recorderOptions) != 1) {
+    recorder.cleanup();
+    if (of) {
+      op_free(of);
+    } else {
+      fclose(fin);
+    }
+    return "failed to open output file";
+  }
+
+  /* Input packets and encoder frames need not have the same duration, so
+     decoded audio is queued in pcm until a whole frame is available. */
+  frame_samples = recorder.frameBytes() / 2;
+  pending = 0;
+  frames = 0;
+
+  if (of) {
+    message = readOgg(of, recorderOptions.channels);
+    op_free(of);
+  } else {
+    message = readRaw(fin, recorderOptions);
+    fclose(fin);
+  }
+
+  if (!message && !drain()) {
+    message = "failed writing frame to output file";
+  }
+  if (!message && !recorder.finish()) {
+    message = "failed writing frame to output file";
+  }
+  return finishRun(message, stats);
+}
+
+/* Fills in *stats after a successful run and readies the recorder for the
+   next one. */
+const char *Normalizer::finishRun(const char *message, NormalizeStats *stats) {
+  if (message) {
+    recorder.cleanup();
+    return message;
+  }
+
+  stats->frames = frames;
+  stats->bytesWritten = recorder.bytesWritten();
+  stats->pagesOut = recorder.pagesOut();
+  stats->writeCalls = recorder.writeCalls();
+  stats->frameAllocations = recorder.frameAllocations();
+
+  recorder.cleanup();
+
+  return NULL;
+}
@@ -0,0 +1,94 @@
+#if !defined( NORMALIZER_H )
+#define NORMALIZER_H
+
+#include <stdio.h>
+#include <vector>
+#include <opus/opus.h>
+#include <ogg/ogg.h>
+#include "recorder.h"
+
+typedef struct OggOpusFile OggOpusFile;
+
+struct NormalizeStats {
+  int frames;
+  opus_int64 bytesWritten;
+  opus_int64 pagesOut;
+  long long writeCalls;
+  /* On the job thread after the first frame; -1 unless counted, see
+     alloc_count.h. */
+  long long frameAllocations;
+};
+
+enum NormalizeMode {
+  /* Always decode and re-encode with the encoder options. */
+  NORMALIZE_TRANSCODE,
+  /* Copy the Opus packets of an Ogg Opus input as they are. */
+  NORMALIZE_REMUX,
+  /* Remux when the input already matches the encoder options. */
+  NORMALIZE_AUTO,
+  /* Only set the output gain in the OpusHead of an Ogg Opus input. */
+  NORMALIZE_GAIN
+};
+
+struct NormalizeOptions {
+  NormalizeOptions() : mode(NORMALIZE_TRANSCODE), gain(0) {}
+
+  RecorderOptions encoder;
+  int mode;
+  /* Output gain for NORMALIZE_GAIN, in dB Q7.8. */
+  int gain;
+};
+
+/* Decode/re-encode pipeline behind Normalize. Input is either an Ogg Opus
+   file or a stream of raw 133-byte Opus packets. A normalizer keeps its
+   decoder and recorder between runs, so a thread that transcodes many files
+   pays for encoder and decoder setup only once. */
+class Normalizer {
+ public:
+  Normalizer();
+  ~Normalizer();
+
+  /* Transcodes or remuxes inPath into outPath. Returns NULL on success or a
+     static error message, and fills in *stats. */
+  const char *run(const char *inPath, const char *outPath,
+                  const NormalizeOptions &options, NormalizeStats *stats);
+
+ private:
+  Normalizer(const Normalizer&);
+  Normalizer& operator=(const Normalizer&);
+
+  const char *readRaw(FILE *fin, const RecorderOptions &options);
+  const char *readOgg(OggOpusFile *of, int channels);
+  const char *remux(FILE *fin, const char *outPath, const RecorderOptions &options);
+  const char *startRemux(const char *outPath, const RecorderOptions &options,
+                         const OpusHeader &header, int *held_duration);
+  const char *rewriteGain(FILE *fin, const char *inPath, const char *outPath, int gain,
+                          NormalizeStats *stats);
+  const char *finishRun(const char *message, NormalizeStats *stats);
+  int queue(int samples);
+  int drain();
+
+  Recorder recorder;
+  OpusDecoder *decoder;
+  opus_int32 decoder_rate;
+  int decoder_channels;
+  /* Decoded audio waiting to be encoded: one input packet plus one
+     partially filled encoder frame. */
+  opus_int16 pcm[5760 * 2 + 2880 * 2];
+  opus_int16 stereo[5760 * 2];
+  int frame_samples;
+  int pending;
+  int frames;
+
+  /* Remux state. The last packet read is held back until the next one shows
+     whether it ends the stream. */
+  ogg_sync_state oy;
+  ogg_stream_state is;
+  std::vector<unsigned char> held;
+  /* Packets of the first audio page, kept until its granule position gives
+     the start offset, and the bytes and duration of each. */
+  std::vector<unsigned char> lead;
+  std::vector<int> lead_packets;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "options.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace v8;
+
+/* Reads object[key] into *value. Returns 1 if it was set, 0 if it is absent
+   and -1 after throwing if it is not a number within [lo, hi]. */
+static int readNumber(Local<Object> object, const char *key, double lo, double hi, double *value) {
+  Local<Value> field = Nan::Get(object, Nan::New(key).ToLocalChecked()).ToLocalChecked();
+  if (field->IsUndefined()) {
+    return 0;
+  }
+
+  char message[128];
+  if (!field->IsNumber()) {
+    snprintf(message, sizeof(message), "%s must be a number", key);
+    Nan::ThrowTypeError(message);
+    return -1;
+  }
+
+  *value = Nan::To<double>(field).FromJust();
+  if (!(*value >= lo && *value <= hi)) {
+    snprintf(message, sizeof(message), "%s must be between %g and %g", key, lo, hi);
+    Nan::ThrowRangeError(message);
+    return -1;
+  }
+  return 1;
+}
+
+/* Like readNumber, for booleans. */
+static int readBoolean(Local<Object> object, const char *key, int *value) {
+  Local<Value> field = Nan::Get(object, Nan::New(key).ToLocalChecked()).ToLocalChecked();
+  if (field->IsUndefined()) {
+    return 0;
+  }
+  if (!field->IsBoolean()) {
+    char message[128];
+    snprintf(message, sizeof(message), "%s must be a boolean", key);
+    Nan::ThrowTypeError(message);
+    return -1;
+  }
+  *value = Nan::To<bool>(field).FromJust() ? 1 : 0;
+  return 1;
+}
+
+static const struct {
+  const char *name;
+  int application;
+} applications[] = {
+  { "voip", OPUS_APPLICATION_VOIP },
+  { "audio", OPUS_APPLICATION_AUDIO },
+  { "restricted-lowdelay", OPUS_APPLICATION_RESTRICTED_LOWDELAY }
+};
+
+int readRecorderOptions(Local<Value> value, RecorderOptions *options) {
+  if (value->IsUndefined() || value->IsNull()) {
+    return 1;
+  }
+  if (!value->IsObject()) {
+    Nan::ThrowTypeError("options must be an object");
+    return 0;
+  }
+
+  Local<Object> object = Local<Object>::Cast(value);
+  double number;
+  int found;
+
+  /* Any whole rate is accepted; the recorder resamples those Opus does not
+     code at. */
+  if ((found = readNumber(object, "sampleRate", 8000, 192000, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    int rate = (int)number;
+    if (number != rate) {
+      Nan::ThrowRangeError("sampleRate must be a whole number of Hz");
+      return 0;
+    }
+    options->rate = rate;
+  }
+
+  if ((found = readNumber(object, "channels", 1, 2, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    int channels = (int)number;
+    if (number != channels) {
+      Nan::ThrowRangeError("channels must be 1 or 2");
+      return 0;
+    }
+    options->channels = channels;
+  }
+
+  if ((found = readNumber(object, "bitrate", 500, 512000, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    options->bitrate = (opus_int32)number;
+  }
+
+  if ((found = readNumber(object, "complexity", 0, 10, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    options->complexity = (int)number;
+  }
+
+  if (readBoolean(object, "vbr", &options->vbr) < 0 || readBoolean(object, "cvbr", &options->cvbr) < 0) {
+    return 0;
+  }
+
+  /* frameDuration is in milliseconds. */
+  if ((found = readNumber(object, "frameDuration", 2.5, 60, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    int duration = (int)(number * 48);
+    if (number * 48 != duration || (duration != 120 && duration != 240 && duration != 480 &&
+                                    duration != 960 && duration != 1920 && duration != 2880)) {
+      Nan::ThrowRangeError("frameDuration must be 2.5, 5, 10, 20, 40 or 60");
+      return 0;
+    }
+    options->frame_duration = duration;
+  }
+
+  Local<Value> application = Nan::Get(object, Nan::New("application").ToLocalChecked()).ToLocalChecked();
+  if (!application->IsUndefined()) {
+    Nan::Utf8String name(application);
+    size_t i;
+    for (i = 0; i < sizeof(applications) / sizeof(applications[0]); i++) {
+      if (application->IsString() && strcmp(*name, applications[i].name) == 0) {
+        options->application = applications[i].application;
+        break;
+      }
+    }
+    if (i == sizeof(applications) / sizeof(applications[0])) {
+      Nan::ThrowRangeError("application must be 'voip', 'audio' or 'restricted-lowdelay'");
+      return 0;
+    }
+  }
+
+  /* maxDelay is in milliseconds, as with opusenc --max-delay. */
+  if ((found = readNumber(object, "maxDelay", 0, 1000, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    options->max_ogg_delay = (int)(number * 48);
+  }
+
+  if ((found = readNumber(object, "flushThreshold", 0, 16 * 1024 * 1024, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    options->flush_threshold = (int)number;
+  }
+
+  return 1;
+}
+
+static const struct {
+  const char *name;
+  int mode;
+} modes[] = {
+  { "transcode", NORMALIZE_TRANSCODE },
+  { "remux", NORMALIZE_REMUX },
+  { "auto", NORMALIZE_AUTO },
+  { "gain", NORMALIZE_GAIN }
+};
+
+int readNormalizeOptions(Local<Value> value, NormalizeOptions *options) {
+  if (!readRecorderOptions(value, &options->encoder)) {
+    return 0;
+  }
+  if (value->IsUndefined() || value->IsNull()) {
+    return 1;
+  }
+
+  Local<Object> object = Local<Object>::Cast(value);
+  Local<Value> mode = Nan::Get(object, Nan::New("mode").ToLocalChecked()).ToLocalChecked();
+  if (!mode->IsUndefined()) {
+    Nan::Utf8String name(mode);
+    size_t i;
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+      if (mode->IsString() && strcmp(*name, modes[i].name) == 0) {
+        options->mode = modes[i].mode;
+        break;
+      }
+    }
+    if (i == sizeof(modes) / sizeof(modes[0])) {
+      Nan::ThrowRangeError("mode must be 'transcode', 'remux', 'auto' or 'gain'");
+      return 0;
+    }
+  }
+
+  /* gain is in dB and is stored as Q7.8, as in the OpusHead. */
+  double number;
+  int found;
+  if ((found = readNumber(object, "gain", -128, 32767 / 256.0, &number)) < 0) {
+    return 0;
+  }
+  if (found) {
+    options->gain = (int)(number * 256 + (number < 0 ? -0.5 : 0.5));
+  }
+
+  return 1;
+}
+
+void setStats(Local<Object> result, const NormalizeStats &stats) {
+  Nan::Set(result, Nan::New("frames").ToLocalChecked(), Nan::New<Number>(stats.frames));
+  Nan::Set(result, Nan::New("bytesWritten").ToLocalChecked(), Nan::New<Number>(stats.bytesWritten));
+  Nan::Set(result, Nan::New("pagesOut").ToLocalChecked(), Nan::New<Number>(stats.pagesOut));
+  Nan::Set(result, Nan::New("writeCalls").ToLocalChecked(), Nan::New<Number>(stats.writeCalls));
+  Nan::Set(result, Nan::New("frameAllocations").ToLocalChecked(), Nan::New<Number>(stats.frameAllocations));
+}
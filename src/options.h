@@ -0,0 +1,18 @@
+#if !defined( OPTIONS_H )
+#define OPTIONS_H
+
+#include <nan.h>
+#include "recorder.h"
+#include "normalizer.h"
+
+/* Fills *options from a JS options object. Missing keys keep their current
+   values. Returns 0 and throws a JS exception if a value is invalid. */
+int readRecorderOptions(v8::Local<v8::Value> value, RecorderOptions *options);
+
+/* readRecorderOptions plus the Normalize-only keys such as mode. */
+int readNormalizeOptions(v8::Local<v8::Value> value, NormalizeOptions *options);
+
+/* Copies the counters in stats onto a JS result object. */
+void setStats(v8::Local<v8::Object> result, const NormalizeStats &stats);
+
+#endif
@@ -0,0 +1,416 @@
+#include "opus_decoder.h"
+#include "common.h"
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+using namespace v8;
+
+Nan::Persistent<Function> OpusFileDecoder::constructor;
+
+OpusFileDecoder::OpusFileDecoder() : of(NULL), stereo(false), buffer_count(0), position(0), channels(0) {}
+
+OpusFileDecoder::~OpusFileDecoder() {
+  release();
+}
+
+/* Stops the prefetch thread before the file it reads goes away. */
+void OpusFileDecoder::release() {
+  prefetcher.stop();
+  for (int i = 0; i < buffer_count; i++) {
+    buffers[i].Reset();
+  }
+  buffer_count = 0;
+  if (of) {
+    op_free(of);
+    of = NULL;
+  }
+  source.Reset();
+}
+
+/* Opens a stream with op_test_open_lazy(), which skips scanning the rest of
+   a chained file until something needs it. Closes the stream on failure. */
+static OggOpusFile *openLazy(void *stream, const OpusFileCallbacks &cb, int *error) {
+  if (stream == NULL) {
+    *error = OP_EFAULT;
+    return NULL;
+  }
+  OggOpusFile *of = op_test_callbacks(stream, &cb, NULL, 0, error);
+  if (of != NULL) {
+    *error = op_test_open_lazy(of);
+    if (*error == 0) {
+      return of;
+    }
+    op_free(of);
+  }
+  (*cb.close)(stream);
+  return NULL;
+}
+
+NAN_MODULE_INIT(OpusFileDecoder::Init) {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("OpusDecoder").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "readInto", ReadInto);
+  Nan::SetPrototypeMethod(tpl, "read", Read);
+  Nan::SetPrototypeMethod(tpl, "pcmSeek", PcmSeek);
+  Nan::SetPrototypeMethod(tpl, "pcmTell", PcmTell);
+  Nan::SetPrototypeMethod(tpl, "buildSeekIndex", BuildSeekIndex);
+  Nan::SetPrototypeMethod(tpl, "saveSeekIndex", SaveSeekIndex);
+  Nan::SetPrototypeMethod(tpl, "pcmTotal", PcmTotal);
+  Nan::SetPrototypeMethod(tpl, "channelCount", ChannelCount);
+  Nan::SetPrototypeMethod(tpl, "close", Close);
+
+  Local<Function> fn = Nan::GetFunction(tpl).ToLocalChecked();
+  constructor.Reset(fn);
+  Nan::Set(target, Nan::New("OpusDecoder").ToLocalChecked(), fn);
+}
+
+NAN_METHOD(OpusFileDecoder::New) {
+  if (!info.IsConstructCall()) {
+    THROW_TYPE_ERROR("Use the new operator to create an OpusDecoder");
+  }
+  if (info.Length() < 1 ||
+      !(info[0]->IsString() || info[0]->IsArrayBufferView() || info[0]->IsArrayBuffer())) {
+    THROW_TYPE_ERROR("Argument 0 must be a path, a Buffer or an ArrayBuffer");
+  }
+
+  /* lazy: return once the first link is ready instead of scanning a chained
+     file for all of its links up front. */
+  bool lazy = false;
+  if (info.Length() > 1 && info[1]->IsObject()) {
+    Local<Value> value = Nan::Get(info[1].As<Object>(), Nan::New("lazy").ToLocalChecked()).ToLocalChecked();
+    lazy = Nan::To<bool>(value).FromMaybe(false);
+  }
+
+  int error = 0;
+  OpusFileCallbacks cb;
+  OpusFileDecoder *decoder = new OpusFileDecoder();
+  if (info[0]->IsString()) {
+    Nan::Utf8String path(info[0]);
+    if (lazy) {
+      void *stream = op_mmap_stream_create(&cb, *path);
+      if (stream == NULL) {
+        stream = op_fopen(&cb, *path, "rb");
+      }
+      decoder->of = openLazy(stream, cb, &error);
+    } else {
+      decoder->of = op_open_mmap(*path, &error);
+    }
+  } else {
+    /* Decoded in place: opusfile reads the JS memory directly, and the
+       reference held in source keeps it alive until close(). */
+    Local<Value> view = info[0];
+    if (view->IsArrayBuffer()) {
+      Local<ArrayBuffer> buffer = view.As<ArrayBuffer>();
+      view = Uint8Array::New(buffer, 0, buffer->ByteLength());
+    }
+    Nan::TypedArrayContents<unsigned char> data(view);
+    if (lazy) {
+      decoder->of = openLazy(op_mem_stream_create(&cb, *data, data.length()), cb, &error);
+    } else {
+      decoder->of = op_open_memory(*data, data.length(), &error);
+    }
+    if (decoder->of) {
+      decoder->source.Reset(view.As<Object>());
+    }
+  }
+  if (decoder->of == NULL) {
+    delete decoder;
+    char message[64];
+    snprintf(message, sizeof(message), "failed to open input file (%d)", error);
+    return Nan::ThrowError(message);
+  }
+
+  /* seekIndex: a Buffer from saveSeekIndex(), loaded before anything else
+     touches the file. */
+  if (info.Length() > 1 && info[1]->IsObject()) {
+    Local<Value> index = Nan::Get(info[1].As<Object>(), Nan::New("seekIndex").ToLocalChecked()).ToLocalChecked();
+    if (!index->IsUndefined()) {
+      if (!node::Buffer::HasInstance(index)) {
+        delete decoder;
+        THROW_TYPE_ERROR("seekIndex must be a Buffer");
+      }
+      int res = op_seek_index_load(decoder->of, reinterpret_cast<const unsigned char *>(node::Buffer::Data(index)),
+                                   node::Buffer::Length(index));
+      if (res < 0) {
+        delete decoder;
+        char message[64];
+        snprintf(message, sizeof(message), "failed loading seek index (%d)", res);
+        return Nan::ThrowError(message);
+      }
+    }
+  }
+
+  /* dither: false rounds 16-bit output without dither; stereo: true makes
+     readInto() and read() downmix or duplicate every link to two channels;
+     rate decodes at 8000, 12000, 16000 or 24000 Hz instead of 48000. */
+  if (info.Length() > 1 && info[1]->IsObject()) {
+    Local<Object> options = Local<Object>::Cast(info[1]);
+    Local<Value> dither = Nan::Get(options, Nan::New("dither").ToLocalChecked()).ToLocalChecked();
+    Local<Value> stereo = Nan::Get(options, Nan::New("stereo").ToLocalChecked()).ToLocalChecked();
+    Local<Value> rate = Nan::Get(options, Nan::New("rate").ToLocalChecked()).ToLocalChecked();
+    if (!rate->IsUndefined() && op_set_decode_rate(decoder->of, Nan::To<int32_t>(rate).FromMaybe(0)) < 0) {
+      delete decoder;
+      return Nan::ThrowRangeError("rate must be 8000, 12000, 16000, 24000 or 48000");
+    }
+    if (!dither->IsUndefined()) {
+      op_set_dither_enabled(decoder->of, Nan::To<bool>(dither).FromMaybe(true));
+    }
+    decoder->stereo = Nan::To<bool>(stereo).FromMaybe(false);
+  }
+
+  /* prefetch: number of buffers to keep decoded ahead; prefetchSamples:
+     samples per channel in each. */
+  if (info.Length() > 1 && info[1]->IsObject()) {
+    Local<Object> options = Local<Object>::Cast(info[1]);
+    Local<Value> prefetch = Nan::Get(options, Nan::New("prefetch").ToLocalChecked()).ToLocalChecked();
+    Local<Value> size = Nan::Get(options, Nan::New("prefetchSamples").ToLocalChecked()).ToLocalChecked();
+    int count = prefetch->IsUndefined() ? 0 : Nan::To<int32_t>(prefetch).FromMaybe(-1);
+    int samples = size->IsUndefined() ? 5760 * 2 : Nan::To<int32_t>(size).FromMaybe(-1);
+    if (count != 0 && (count < 2 || count > MAX_PREFETCH)) {
+      delete decoder;
+      return Nan::ThrowRangeError("prefetch must be between 2 and 16");
+    }
+    if (samples < 5760 || samples > 48000 * 10) {
+      delete decoder;
+      return Nan::ThrowRangeError("prefetchSamples must be between 5760 and 480000");
+    }
+
+    if (count > 0) {
+      /* Later links of an unseekable stream are unknown, so allow for the
+         most channels opusfile decodes. Stereo output is always two. */
+      int widest = decoder->stereo ? 2 : 8;
+      if (!decoder->stereo && op_seekable(decoder->of)) {
+        widest = 1;
+        for (int li = 0; li < op_link_count(decoder->of); li++) {
+          widest = std::max(widest, op_channel_count(decoder->of, li));
+        }
+      }
+
+      std::vector<opus_int16 *> pcm(count);
+      for (int i = 0; i < count; i++) {
+        Local<Object> buffer = Nan::NewBuffer(samples * widest * sizeof(opus_int16)).ToLocalChecked();
+        decoder->buffers[i].Reset(buffer);
+        pcm[i] = reinterpret_cast<opus_int16 *>(node::Buffer::Data(buffer));
+      }
+      decoder->buffer_count = count;
+      decoder->channels = decoder->stereo ? 2 : op_channel_count(decoder->of, 0);
+
+      if (!decoder->prefetcher.start(decoder->of, pcm, samples, decoder->stereo)) {
+        delete decoder;
+        return Nan::ThrowError("failed to start the prefetch thread");
+      }
+    }
+  }
+
+  decoder->Wrap(info.This());
+  info.GetReturnValue().Set(info.This());
+}
+
+/* Unwraps the receiver, throwing if it has been closed. */
+OpusFileDecoder *OpusFileDecoder::Open(const Nan::FunctionCallbackInfo<Value> &info) {
+  OpusFileDecoder *decoder = Nan::ObjectWrap::Unwrap<OpusFileDecoder>(info.Holder());
+  if (!decoder->of) {
+    Nan::ThrowError("OpusDecoder is closed");
+    return NULL;
+  }
+  return decoder;
+}
+
+/* readInto(pcm): decodes into an Int16Array or Float32Array, interleaved,
+   without an intermediate copy. Returns {samples, link}, where samples is
+   per channel and 0 at the end of the stream. As with op_read, one call
+   decodes at most one packet. */
+NAN_METHOD(OpusFileDecoder::ReadInto) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+  if (decoder->prefetcher.running()) {
+    return Nan::ThrowError("Use read() on a prefetching OpusDecoder");
+  }
+  if (info.Length() < 1 || !(info[0]->IsInt16Array() || info[0]->IsFloat32Array())) {
+    THROW_TYPE_ERROR("Argument 0 must be an Int16Array or a Float32Array");
+  }
+
+  int link = -1;
+  int res;
+  do {
+    if (info[0]->IsInt16Array()) {
+      Nan::TypedArrayContents<opus_int16> pcm(info[0]);
+      if (decoder->stereo) {
+        res = op_read_stereo(decoder->of, *pcm, (int)pcm.length());
+      } else {
+        res = op_read(decoder->of, *pcm, (int)pcm.length(), &link);
+      }
+    } else {
+      Nan::TypedArrayContents<float> pcm(info[0]);
+      if (decoder->stereo) {
+        res = op_read_float_stereo(decoder->of, *pcm, (int)pcm.length());
+      } else {
+        res = op_read_float(decoder->of, *pcm, (int)pcm.length(), &link);
+      }
+    }
+    /* A hole in the data is not fatal; decoding resumes after it. */
+  } while (res == OP_HOLE);
+
+  if (res < 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "failed decoding input file (%d)", res);
+    return Nan::ThrowError(message);
+  }
+
+  if (decoder->stereo) {
+    link = op_current_link(decoder->of);
+  }
+
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("samples").ToLocalChecked(), Nan::New<Number>(res));
+  Nan::Set(result, Nan::New("link").ToLocalChecked(), Nan::New<Number>(link));
+  info.GetReturnValue().Set(result);
+}
+
+/* read(): takes the next prefetched buffer as {pcm, samples, link}, where
+   pcm is an Int16Array over the decoder's own memory. It stays valid until
+   the next read(), pcmSeek() or close(), after which the buffer is refilled.
+   Returns null at the end of the stream. */
+NAN_METHOD(OpusFileDecoder::Read) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+  if (!decoder->prefetcher.running()) {
+    return Nan::ThrowError("read() needs an OpusDecoder opened with options.prefetch");
+  }
+
+  const Prefetcher::Slot *slot = decoder->prefetcher.next();
+  if (!slot) {
+    if (decoder->prefetcher.error() < 0) {
+      char message[64];
+      snprintf(message, sizeof(message), "failed decoding input file (%d)", decoder->prefetcher.error());
+      return Nan::ThrowError(message);
+    }
+    info.GetReturnValue().SetNull();
+    return;
+  }
+
+  decoder->position = slot->offset + slot->samples;
+  decoder->channels = slot->channels;
+
+  Local<Object> buffer = Nan::New(decoder->buffers[slot->index]);
+  Local<Int16Array> pcm = Int16Array::New(buffer.As<Uint8Array>()->Buffer(),
+                                          buffer.As<Uint8Array>()->ByteOffset(),
+                                          slot->samples * slot->channels);
+
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("pcm").ToLocalChecked(), pcm);
+  Nan::Set(result, Nan::New("samples").ToLocalChecked(), Nan::New<Number>(slot->samples));
+  Nan::Set(result, Nan::New("link").ToLocalChecked(), Nan::New<Number>(slot->link));
+  info.GetReturnValue().Set(result);
+}
+
+/* pcmSeek(offset): seeks to a sample offset (per channel, at the decode rate). */
+NAN_METHOD(OpusFileDecoder::PcmSeek) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+  if (info.Length() < 1 || !info[0]->IsNumber()) {
+    THROW_TYPE_ERROR("Argument 0 must be a number");
+  }
+
+  ogg_int64_t offset = (ogg_int64_t)Nan::To<double>(info[0]).FromJust();
+  int res;
+  if (decoder->prefetcher.running()) {
+    res = decoder->prefetcher.seek(offset);
+    decoder->position = offset;
+  } else {
+    res = op_pcm_seek(decoder->of, offset);
+  }
+  if (res < 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "failed seeking input file (%d)", res);
+    return Nan::ThrowError(message);
+  }
+}
+
+/* buildSeekIndex([interval]): indexes one page per interval samples (default
+   48000) so that pcmSeek() no longer bisects the file. */
+NAN_METHOD(OpusFileDecoder::BuildSeekIndex) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+  if (decoder->prefetcher.running()) {
+    return Nan::ThrowError("Pass seekIndex to a prefetching OpusDecoder instead");
+  }
+
+  opus_int32 interval = info.Length() > 0 ? Nan::To<int32_t>(info[0]).FromMaybe(0) : 0;
+  int res = op_seek_index_build(decoder->of, interval);
+  if (res < 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "failed building seek index (%d)", res);
+    return Nan::ThrowError(message);
+  }
+}
+
+/* saveSeekIndex(): the index as a Buffer, to keep next to the file and pass
+   back as options.seekIndex, or null if there is none. */
+NAN_METHOD(OpusFileDecoder::SaveSeekIndex) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+
+  opus_int64 size = op_seek_index_save(decoder->of, NULL, 0);
+  if (size < 0) {
+    info.GetReturnValue().SetNull();
+    return;
+  }
+  Local<Object> buffer = Nan::NewBuffer((uint32_t)size).ToLocalChecked();
+  op_seek_index_save(decoder->of, reinterpret_cast<unsigned char *>(node::Buffer::Data(buffer)), (size_t)size);
+  info.GetReturnValue().Set(buffer);
+}
+
+NAN_METHOD(OpusFileDecoder::PcmTell) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+  /* The prefetch thread runs ahead of what has been read. */
+  ogg_int64_t position = decoder->prefetcher.running() ? decoder->position : op_pcm_tell(decoder->of);
+  info.GetReturnValue().Set(Nan::New<Number>((double)position));
+}
+
+/* pcmTotal([link]): duration in samples per channel, of one link or, by
+   default, the whole file. */
+NAN_METHOD(OpusFileDecoder::PcmTotal) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+  int link = info.Length() > 0 ? Nan::To<int32_t>(info[0]).FromMaybe(-1) : -1;
+  info.GetReturnValue().Set(Nan::New<Number>((double)op_pcm_total(decoder->of, link)));
+}
+
+/* channelCount([link]): channels of one link, by default the current one.
+   While prefetching, that is the link of the last buffer read. */
+NAN_METHOD(OpusFileDecoder::ChannelCount) {
+  OpusFileDecoder *decoder = Open(info);
+  if (!decoder) {
+    return;
+  }
+  int link = info.Length() > 0 ? Nan::To<int32_t>(info[0]).FromMaybe(-1) : -1;
+  if (link < 0 && decoder->prefetcher.running()) {
+    info.GetReturnValue().Set(Nan::New<Number>(decoder->channels));
+    return;
+  }
+  info.GetReturnValue().Set(Nan::New<Number>(op_channel_count(decoder->of, link)));
+}
+
+NAN_METHOD(OpusFileDecoder::Close) {
+  OpusFileDecoder *decoder = Nan::ObjectWrap::Unwrap<OpusFileDecoder>(info.Holder());
+  decoder->release();
+}
@@ -0,0 +1,55 @@
+#if !defined( OPUS_DECODER_H )
+#define OPUS_DECODER_H
+
+#include <nan.h>
+#include "../deps/opusfile/include/opusfile.h"
+#include "prefetcher.h"
+
+/* Most buffers a prefetching decoder may keep. */
+#define MAX_PREFETCH 16
+
+/* JS handle around an OggOpusFile, exported as OpusDecoder (libopus already
+   owns that name in C++): new OpusDecoder(path | buffer[, options]),
+   readInto(pcm), read(), pcmSeek(), pcmTell(), pcmTotal(), channelCount(),
+   buildSeekIndex(), saveSeekIndex(), close().
+   With options.prefetch a Prefetcher decodes ahead on its own thread into
+   buffers owned by JS, and read() hands them out one at a time. */
+class OpusFileDecoder : public Nan::ObjectWrap {
+ public:
+  static NAN_MODULE_INIT(Init);
+
+ private:
+  OpusFileDecoder();
+  ~OpusFileDecoder();
+
+  static NAN_METHOD(New);
+  static NAN_METHOD(ReadInto);
+  static NAN_METHOD(Read);
+  static NAN_METHOD(PcmSeek);
+  static NAN_METHOD(PcmTell);
+  static NAN_METHOD(BuildSeekIndex);
+  static NAN_METHOD(SaveSeekIndex);
+  static NAN_METHOD(PcmTotal);
+  static NAN_METHOD(ChannelCount);
+  static NAN_METHOD(Close);
+
+  static OpusFileDecoder *Open(const Nan::FunctionCallbackInfo<v8::Value> &info);
+
+  static Nan::Persistent<v8::Function> constructor;
+
+  void release();
+
+  OggOpusFile *of;
+  /* readInto() uses op_read_stereo() and op_read_float_stereo(). */
+  bool stereo;
+  /* The Buffer or ArrayBuffer being decoded, when not reading a file. */
+  Nan::Persistent<v8::Object> source;
+  Prefetcher prefetcher;
+  Nan::Persistent<v8::Object> buffers[MAX_PREFETCH];
+  int buffer_count;
+  /* Where the last slot handed out by read() ended, and its layout. */
+  ogg_int64_t position;
+  int channels;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "opus_writer.h"
+#include "common.h"
+#include "options.h"
+
+using namespace v8;
+
+Nan::Persistent<Function> OpusWriter::constructor;
+
+OpusWriter::OpusWriter() : open(false), frames(0), frame_allocations(0) {}
+
+OpusWriter::~OpusWriter() {}
+
+NAN_MODULE_INIT(OpusWriter::Init) {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("OpusWriter").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "write", Write);
+  Nan::SetPrototypeMethod(tpl, "close", Close);
+  Nan::SetPrototypeMethod(tpl, "stats", Stats);
+
+  Local<Function> fn = Nan::GetFunction(tpl).ToLocalChecked();
+  constructor.Reset(fn);
+  Nan::Set(target, Nan::New("OpusWriter").ToLocalChecked(), fn);
+}
+
+NAN_METHOD(OpusWriter::New) {
+  if (!info.IsConstructCall()) {
+    THROW_TYPE_ERROR("Use the new operator to create an OpusWriter");
+  }
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    THROW_TYPE_ERROR("Argument 0 must be a string");
+  }
+
+  RecorderOptions options;
+  if (info.Length() > 1 && !readRecorderOptions(info[1], &options)) {
+    return;
+  }
+
+  Nan::Utf8String path(info[0]);
+  OpusWriter *writer = new OpusWriter();
+  if (writer->recorder.init(*path, options) != 1) {
+    delete writer;
+    return Nan::ThrowError("failed to open output file");
+  }
+  writer->open = true;
+
+  writer->Wrap(info.This());
+  info.GetReturnValue().Set(info.This());
+}
+
+/* write(pcm): encodes one frame of 16-bit little-endian PCM. A frame shorter
+   than the encoder frame size is padded and marks the end of the stream. */
+NAN_METHOD(OpusWriter::Write) {
+  OpusWriter *writer = Nan::ObjectWrap::Unwrap<OpusWriter>(info.Holder());
+  if (!writer->open) {
+    return Nan::ThrowError("OpusWriter is closed");
+  }
+  if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+    THROW_TYPE_ERROR("Argument 0 must be a Buffer");
+  }
+
+  uint8_t *data = reinterpret_cast<uint8_t *>(node::Buffer::Data(info[0]));
+  size_t length = node::Buffer::Length(info[0]);
+  if (length > (size_t)writer->recorder.frameBytes()) {
+    return Nan::ThrowRangeError("PCM frame is larger than the encoder frame size");
+  }
+  /* Only count inside the encoder: the JS between writes runs on this
+     thread as well. */
+  long long before = threadAllocations();
+  if (!writer->recorder.writeFrame(data, length)) {
+    return Nan::ThrowError("failed writing frame to output file");
+  }
+  if (before < 0) {
+    writer->frame_allocations = -1;
+  } else if (writer->frames > 0) {
+    writer->frame_allocations += threadAllocations() - before;
+  }
+  writer->frames++;
+}
+
+NAN_METHOD(OpusWriter::Close) {
+  OpusWriter *writer = Nan::ObjectWrap::Unwrap<OpusWriter>(info.Holder());
+  if (writer->open) {
+    int flushed = writer->recorder.finish();
+    writer->recorder.cleanup();
+    writer->open = false;
+    if (!flushed) {
+      return Nan::ThrowError("failed writing frame to output file");
+    }
+  }
+}
+
+/* stats(): counters for the file being written; only valid before close(). */
+NAN_METHOD(OpusWriter::Stats) {
+  OpusWriter *writer = Nan::ObjectWrap::Unwrap<OpusWriter>(info.Holder());
+
+  NormalizeStats stats;
+  stats.frames = writer->frames;
+  stats.bytesWritten = writer->recorder.bytesWritten();
+  stats.pagesOut = writer->recorder.pagesOut();
+  stats.writeCalls = writer->recorder.writeCalls();
+  stats.frameAllocations = writer->frame_allocations;
+
+  Local<Object> result = Nan::New<Object>();
+  setStats(result, stats);
+  info.GetReturnValue().Set(result);
+}
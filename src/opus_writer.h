@@ -0,0 +1,31 @@
+#if !defined( OPUS_WRITER_H )
+#define OPUS_WRITER_H
+
+#include <nan.h>
+#include "recorder.h"
+
+/* JS handle around a Recorder: new OpusWriter(path[, options]), write(pcm),
+   stats(), close(). */
+class OpusWriter : public Nan::ObjectWrap {
+ public:
+  static NAN_MODULE_INIT(Init);
+
+ private:
+  OpusWriter();
+  ~OpusWriter();
+
+  static NAN_METHOD(New);
+  static NAN_METHOD(Write);
+  static NAN_METHOD(Close);
+  static NAN_METHOD(Stats);
+
+  static Nan::Persistent<v8::Function> constructor;
+
+  Recorder recorder;
+  bool open;
+  int frames;
+  /* Allocations inside write() after the first frame. */
+  long long frame_allocations;
+};
+
+#endif
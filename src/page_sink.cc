@@ -0,0 +1,134 @@
+#include "page_sink.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+PageSink::PageSink()
+  : fd(-1), buffer(0), capacity(0), fill(0), threshold(0), write_calls(0) {}
+
+PageSink::~PageSink() {
+  close();
+  free(buffer);
+}
+
+int PageSink::open(const char *path, size_t threshold_) {
+  close();
+
+  if (threshold_ > capacity) {
+    unsigned char *grown = static_cast<unsigned char *>(realloc(buffer, threshold_));
+    if (!grown) {
+      return 0;
+    }
+    buffer = grown;
+    capacity = threshold_;
+  }
+
+#if defined(_WIN32)
+  fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+  fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+  if (fd < 0) {
+    return 0;
+  }
+
+  threshold = threshold_;
+  fill = 0;
+  write_calls = 0;
+  return 1;
+}
+
+/* Writes every chunk in full, retrying short writes. */
+int PageSink::writeChunks(Chunk *chunks, int count) {
+  while (count > 0) {
+#if defined(_WIN32)
+    int written = _write(fd, chunks->data, (unsigned int)chunks->length);
+#else
+    struct iovec iov[3];
+    for (int i = 0; i < count; i++) {
+      iov[i].iov_base = const_cast<unsigned char *>(chunks[i].data);
+      iov[i].iov_len = chunks[i].length;
+    }
+    ssize_t written = writev(fd, iov, count);
+#endif
+    write_calls++;
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 0;
+    }
+
+    size_t left = (size_t)written;
+    while (count > 0 && left >= chunks->length) {
+      left -= chunks->length;
+      chunks++;
+      count--;
+    }
+    if (count > 0) {
+      chunks->data += left;
+      chunks->length -= left;
+    }
+  }
+
+  return 1;
+}
+
+long PageSink::write(const ogg_page *page) {
+  size_t pageBytes = page->header_len + page->body_len;
+
+  if (fill + pageBytes <= threshold) {
+    memcpy(buffer + fill, page->header, page->header_len);
+    memcpy(buffer + fill + page->header_len, page->body, page->body_len);
+    fill += pageBytes;
+    if (fill == threshold && !flush()) {
+      return -1;
+    }
+    return (long)pageBytes;
+  }
+
+  Chunk chunks[3] = {
+    { buffer, fill },
+    { page->header, (size_t)page->header_len },
+    { page->body, (size_t)page->body_len }
+  };
+  int first = fill > 0 ? 0 : 1;
+  fill = 0;
+  if (!writeChunks(chunks + first, 3 - first)) {
+    return -1;
+  }
+  return (long)pageBytes;
+}
+
+int PageSink::flush() {
+  if (fill == 0) {
+    return 1;
+  }
+
+  Chunk chunk = { buffer, fill };
+  fill = 0;
+  return writeChunks(&chunk, 1);
+}
+
+int PageSink::close() {
+  if (fd < 0) {
+    return 1;
+  }
+
+  int result = flush();
+#if defined(_WIN32)
+  result = _close(fd) == 0 && result;
+#else
+  result = ::close(fd) == 0 && result;
+#endif
+  fd = -1;
+  return result;
+}
@@ -0,0 +1,46 @@
+#if !defined( PAGE_SINK_H )
+#define PAGE_SINK_H
+
+#include <stddef.h>
+#include <ogg/ogg.h>
+
+/* Output file for Ogg pages. Pages are gathered into one contiguous buffer
+   and written out once `threshold` bytes are pending; a page that does not
+   fit is sent together with the pending bytes in a single writev(). With a
+   threshold of 0 every page goes out immediately, header and body in one
+   call. The buffer survives close() so a sink can be reopened for the next
+   file without allocating. */
+class PageSink {
+ public:
+  PageSink();
+  ~PageSink();
+
+  int open(const char *path, size_t threshold);
+  /* Returns the page size on success and -1 if the write failed. */
+  long write(const ogg_page *page);
+  int flush();
+  int close();
+
+  bool isOpen() const { return fd >= 0; }
+  long long writeCalls() const { return write_calls; }
+
+ private:
+  PageSink(const PageSink&);
+  PageSink& operator=(const PageSink&);
+
+  struct Chunk {
+    const unsigned char *data;
+    size_t length;
+  };
+
+  int writeChunks(Chunk *chunks, int count);
+
+  int fd;
+  unsigned char *buffer;
+  size_t capacity;
+  size_t fill;
+  size_t threshold;
+  long long write_calls;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "prefetcher.h"
+#include <string.h>
+
+/* Most op_read can return at once: 120 ms at 48 kHz, eight channels. */
+#define MAX_READ_SAMPLES (5760 * 8)
+
+Prefetcher::Prefetcher()
+  : of(NULL), capacity(0), stereo(false), carried(0), carried_channels(0), carried_link(-1), carried_offset(0),
+    started(false), head(0), filled(0), held(false), busy(false), paused(false), done(false),
+    quit(false), status(0) {
+  uv_mutex_init(&mutex);
+  uv_cond_init(&cond);
+}
+
+Prefetcher::~Prefetcher() {
+  stop();
+  uv_cond_destroy(&cond);
+  uv_mutex_destroy(&mutex);
+}
+
+int Prefetcher::start(OggOpusFile *file, const std::vector<opus_int16 *> &buffers, int samples, bool toStereo) {
+  stop();
+
+  of = file;
+  capacity = samples;
+  stereo = toStereo;
+  slots.resize(buffers.size());
+  for (size_t i = 0; i < slots.size(); i++) {
+    slots[i].index = (int)i;
+    slots[i].pcm = buffers[i];
+    slots[i].samples = 0;
+  }
+  scratch.resize(MAX_READ_SAMPLES);
+  carried = 0;
+
+  head = 0;
+  filled = 0;
+  held = false;
+  busy = false;
+  paused = false;
+  done = false;
+  quit = false;
+  status = 0;
+
+  if (uv_thread_create(&thread, Run, this) != 0) {
+    return 0;
+  }
+  started = true;
+  return 1;
+}
+
+void Prefetcher::stop() {
+  if (!started) {
+    return;
+  }
+
+  uv_mutex_lock(&mutex);
+  quit = true;
+  uv_cond_broadcast(&cond);
+  uv_mutex_unlock(&mutex);
+
+  uv_thread_join(&thread);
+  started = false;
+}
+
+const Prefetcher::Slot *Prefetcher::next() {
+  uv_mutex_lock(&mutex);
+  if (held) {
+    head = (head + 1) % slots.size();
+    held = false;
+    uv_cond_broadcast(&cond);
+  }
+  while (filled == 0 && !done) {
+    uv_cond_wait(&cond, &mutex);
+  }
+
+  const Slot *slot = NULL;
+  if (filled > 0) {
+    filled--;
+    held = true;
+    slot = &slots[head];
+  }
+  uv_mutex_unlock(&mutex);
+  return slot;
+}
+
+int Prefetcher::seek(ogg_int64_t offset) {
+  uv_mutex_lock(&mutex);
+  paused = true;
+  while (busy) {
+    uv_cond_wait(&cond, &mutex);
+  }
+
+  /* The thread is parked, so the file is ours until paused is cleared. */
+  int res = op_pcm_seek(of, offset);
+  head = 0;
+  filled = 0;
+  held = false;
+  carried = 0;
+  done = res < 0;
+  status = res < 0 ? res : 0;
+  paused = false;
+  uv_cond_broadcast(&cond);
+  uv_mutex_unlock(&mutex);
+  return res;
+}
+
+/* Decodes into slot until it cannot take another packet, the stream ends
+   or the link changes. Returns 1 if there is more to come, 0 at the end of
+   the stream and a negative opusfile error code on failure. */
+int Prefetcher::fill(Slot *slot) {
+  slot->samples = 0;
+  slot->link = -1;
+  slot->channels = 0;
+
+  for (;;) {
+    if (carried == 0) {
+      ogg_int64_t offset = op_pcm_tell(of);
+      int link = -1;
+      int res;
+      if (stereo) {
+        res = op_read_stereo(of, &scratch[0], MAX_READ_SAMPLES);
+        link = op_current_link(of);
+      } else {
+        res = op_read(of, &scratch[0], MAX_READ_SAMPLES, &link);
+      }
+      if (res == OP_HOLE) {
+        continue;
+      }
+      if (res <= 0) {
+        return res;
+      }
+      carried = res;
+      carried_channels = stereo ? 2 : op_channel_count(of, link);
+      carried_link = link;
+      carried_offset = offset;
+    }
+
+    if (slot->samples > 0 && (carried_link != slot->link || slot->samples + carried > capacity)) {
+      return 1;
+    }
+    if (slot->samples == 0) {
+      slot->link = carried_link;
+      slot->channels = carried_channels;
+      slot->offset = carried_offset;
+    }
+    memcpy(slot->pcm + slot->samples * slot->channels, &scratch[0],
+           carried * carried_channels * sizeof(opus_int16));
+    slot->samples += carried;
+    carried = 0;
+  }
+}
+
+void Prefetcher::Run(void *arg) {
+  Prefetcher *self = static_cast<Prefetcher *>(arg);
+
+  uv_mutex_lock(&self->mutex);
+  for (;;) {
+    while (!self->quit && (self->paused || self->done ||
+                           self->filled + (self->held ? 1 : 0) >= self->slots.size())) {
+      uv_cond_wait(&self->cond, &self->mutex);
+    }
+    if (self->quit) {
+      break;
+    }
+
+    size_t index = (self->head + (self->held ? 1 : 0) + self->filled) % self->slots.size();
+    Slot *slot = &self->slots[index];
+    self->busy = true;
+    uv_mutex_unlock(&self->mutex);
+
+    int res = self->fill(slot);
+
+    uv_mutex_lock(&self->mutex);
+    self->busy = false;
+    /* A seek arrived while decoding; what was decoded is stale. */
+    if (!self->paused) {
+      if (slot->samples > 0) {
+        self->filled++;
+      }
+      if (res <= 0) {
+        self->done = true;
+        self->status = res;
+      }
+    }
+    uv_cond_broadcast(&self->cond);
+  }
+  uv_mutex_unlock(&self->mutex);
+}
@@ -0,0 +1,81 @@
+#if !defined( PREFETCHER_H )
+#define PREFETCHER_H
+
+#include <vector>
+#include <uv.h>
+#include "../deps/opusfile/include/opusfile.h"
+
+/* Keeps a ring of decoded PCM buffers filled from an OggOpusFile on a
+   background thread. The consumer takes one filled buffer at a time and
+   hands it back on its next call, so a read costs a lock and no decoding.
+   The buffers belong to the caller and must outlive the prefetcher; every
+   buffer must hold `samples` samples of the widest link, or of two channels
+   when decoding to stereo. */
+class Prefetcher {
+ public:
+  struct Slot {
+    /* Which of the buffers passed to start() this is. */
+    int index;
+    opus_int16 *pcm;
+    /* Per channel. A slot never spans links, so channels is fixed. */
+    int samples;
+    int channels;
+    int link;
+    /* Position of the first sample, per channel at the decode rate. */
+    ogg_int64_t offset;
+  };
+
+  Prefetcher();
+  ~Prefetcher();
+
+  /* Starts decoding `of` into `buffers`. samples must be at least 5760,
+     the longest packet. With stereo every link is downmixed or duplicated
+     to two channels by op_read_stereo(). The file must not be used by
+     anyone else until stop(). Returns 0 if the thread failed to start. */
+  int start(OggOpusFile *of, const std::vector<opus_int16 *> &buffers, int samples, bool stereo = false);
+  /* Returns the next filled slot, waiting for it if the thread is behind,
+     and recycles the previous one. Returns NULL at the end of the stream
+     and after an error, which error() then reports. */
+  const Slot *next();
+  /* Drops everything prefetched, seeks and starts refilling. */
+  int seek(ogg_int64_t offset);
+  void stop();
+
+  int error() const { return status; }
+  bool running() const { return started; }
+
+ private:
+  Prefetcher(const Prefetcher&);
+  Prefetcher& operator=(const Prefetcher&);
+
+  static void Run(void *arg);
+  int fill(Slot *slot);
+
+  OggOpusFile *of;
+  std::vector<Slot> slots;
+  int capacity;
+  bool stereo;
+  /* Decoded audio that belongs to the next link, carried into the next
+     slot. */
+  std::vector<opus_int16> scratch;
+  int carried;
+  int carried_channels;
+  int carried_link;
+  ogg_int64_t carried_offset;
+
+  uv_thread_t thread;
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  bool started;
+  /* Guarded by mutex. head is the slot the consumer holds or takes next. */
+  size_t head;
+  size_t filled;
+  bool held;
+  bool busy;
+  bool paused;
+  bool done;
+  bool quit;
+  int status;
+};
+
+#endif
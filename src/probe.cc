@@ -0,0 +1,267 @@
+#include "probe.h"
+#include "common.h"
+#include "quick_probe.h"
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace v8;
+
+MetadataCache MetadataProbe::cache;
+
+/* Probes one file through the cache on the libuv threadpool, for the misses
+   that have to open it and scan to its end. */
+class ProbeWorker : public Nan::AsyncWorker {
+ public:
+  ProbeWorker(Nan::Callback *callback, const char *path) : Nan::AsyncWorker(callback), path(path) {}
+
+  void Execute() {
+    int res = MetadataProbe::cache.probe(path.c_str(), &metadata);
+    if (res < 0) {
+      char message[64];
+      snprintf(message, sizeof(message), "failed to probe input file (%d)", res);
+      SetErrorMessage(message);
+    }
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    Local<Value> argv[] = { Nan::Null(), MetadataProbe::toObject(metadata) };
+    callback->Call(2, argv);
+  }
+
+ private:
+  std::string path;
+  FileMetadata metadata;
+};
+
+/* Runs quickProbe() over a list of paths on `concurrency` native threads,
+   which pull the next index until the list is drained. */
+class ProbeBatchWorker : public Nan::AsyncWorker {
+ public:
+  ProbeBatchWorker(Nan::Callback *callback, int concurrency, bool duration)
+    : Nan::AsyncWorker(callback), concurrency(concurrency), duration(duration), next(0) {}
+
+  std::vector<std::string> paths;
+
+  void Execute() {
+    results.resize(paths.size());
+    int threads = std::min<int>(concurrency, paths.size());
+    std::vector<uv_thread_t> helpers(threads > 1 ? threads - 1 : 0);
+
+    int started = 0;
+    for (size_t i = 0; i < helpers.size(); i++) {
+      if (uv_thread_create(&helpers[i], Drain, this) != 0) {
+        break;
+      }
+      started++;
+    }
+
+    Drain(this);
+
+    for (int i = 0; i < started; i++) {
+      uv_thread_join(&helpers[i]);
+    }
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    size_t count = results.size();
+    Local<Int32Array> status = Int32Array::New(ArrayBuffer::New(Isolate::GetCurrent(), count * 4), 0, count);
+    Local<Uint8Array> channels = Uint8Array::New(ArrayBuffer::New(Isolate::GetCurrent(), count), 0, count);
+    Local<Float64Array> durations = Float64Array::New(ArrayBuffer::New(Isolate::GetCurrent(), count * 8), 0, count);
+    Nan::TypedArrayContents<int32_t> statusData(status);
+    Nan::TypedArrayContents<uint8_t> channelData(channels);
+    Nan::TypedArrayContents<double> durationData(durations);
+    for (size_t i = 0; i < count; i++) {
+      (*statusData)[i] = results[i].status;
+      (*channelData)[i] = (uint8_t)results[i].channels;
+      (*durationData)[i] = (double)results[i].duration;
+    }
+
+    Local<Object> result = Nan::New<Object>();
+    Nan::Set(result, Nan::New("status").ToLocalChecked(), status);
+    Nan::Set(result, Nan::New("channels").ToLocalChecked(), channels);
+    Nan::Set(result, Nan::New("duration").ToLocalChecked(), durations);
+
+    Local<Value> argv[] = { Nan::Null(), result };
+    callback->Call(2, argv);
+  }
+
+ private:
+  static void Drain(void *arg) {
+    ProbeBatchWorker *self = static_cast<ProbeBatchWorker *>(arg);
+
+    for (;;) {
+      size_t i = self->next++;
+      if (i >= self->paths.size()) {
+        break;
+      }
+      quickProbe(self->paths[i].c_str(), self->duration, &self->results[i]);
+    }
+  }
+
+  int concurrency;
+  bool duration;
+  std::vector<QuickProbe> results;
+  std::atomic<size_t> next;
+};
+
+NAN_MODULE_INIT(MetadataProbe::Init) {
+  Nan::SetMethod(target, "Probe", Probe);
+  Nan::SetMethod(target, "ProbeCached", ProbeCached);
+  Nan::SetMethod(target, "ProbeAsync", ProbeAsync);
+  Nan::SetMethod(target, "ProbeCacheSave", ProbeCacheSave);
+  Nan::SetMethod(target, "ProbeCacheLoad", ProbeCacheLoad);
+  Nan::SetMethod(target, "ProbeCacheSetCapacity", ProbeCacheSetCapacity);
+  Nan::SetMethod(target, "ProbeCacheClear", ProbeCacheClear);
+  Nan::SetMethod(target, "ProbeCacheStats", ProbeCacheStats);
+  Nan::SetMethod(target, "ProbeBatch", ProbeBatch);
+}
+
+Local<Object> MetadataProbe::toObject(const FileMetadata &metadata) {
+  Nan::EscapableHandleScope scope;
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("duration").ToLocalChecked(), Nan::New<Number>((double)metadata.duration));
+  Nan::Set(result, Nan::New("links").ToLocalChecked(), Nan::New<Number>(metadata.links));
+  Nan::Set(result, Nan::New("channels").ToLocalChecked(), Nan::New<Number>(metadata.channels));
+  Nan::Set(result, Nan::New("inputSampleRate").ToLocalChecked(), Nan::New<Number>(metadata.input_sample_rate));
+  Nan::Set(result, Nan::New("outputGain").ToLocalChecked(), Nan::New<Number>(metadata.output_gain / 256.0));
+  Nan::Set(result, Nan::New("preSkip").ToLocalChecked(), Nan::New<Number>(metadata.pre_skip));
+  Nan::Set(result, Nan::New("mappingFamily").ToLocalChecked(), Nan::New<Number>(metadata.mapping_family));
+  Nan::Set(result, Nan::New("bitrate").ToLocalChecked(), Nan::New<Number>(metadata.bitrate));
+  Nan::Set(result, Nan::New("vendor").ToLocalChecked(), Nan::New(metadata.vendor).ToLocalChecked());
+
+  Local<Array> tags = Nan::New<Array>(metadata.comments.size());
+  for (size_t i = 0; i < metadata.comments.size(); i++) {
+    Nan::Set(tags, i, Nan::New(metadata.comments[i]).ToLocalChecked());
+  }
+  Nan::Set(result, Nan::New("tags").ToLocalChecked(), tags);
+  return scope.Escape(result);
+}
+
+/* Probe(path): metadata of an Ogg Opus file, from the cache while the file
+   is unchanged. Blocks on a miss; see ProbeAsync(). */
+NAN_METHOD(MetadataProbe::Probe) {
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    THROW_TYPE_ERROR("Argument 0 must be a path");
+  }
+
+  Nan::Utf8String path(info[0]);
+  FileMetadata metadata;
+  int res = cache.probe(*path, &metadata);
+  if (res < 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "failed to probe input file (%d)", res);
+    return Nan::ThrowError(message);
+  }
+  info.GetReturnValue().Set(toObject(metadata));
+}
+
+/* ProbeCached(path): the cached metadata while the file is unchanged, at
+   the cost of a stat, or undefined when it has to be probed. */
+NAN_METHOD(MetadataProbe::ProbeCached) {
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    THROW_TYPE_ERROR("Argument 0 must be a path");
+  }
+
+  Nan::Utf8String path(info[0]);
+  FileMetadata metadata;
+  if (cache.lookup(*path, &metadata) == 1) {
+    info.GetReturnValue().Set(toObject(metadata));
+  }
+}
+
+/* ProbeAsync(path, callback): Probe() on the threadpool. */
+NAN_METHOD(MetadataProbe::ProbeAsync) {
+  if (info.Length() < 2 || !info[0]->IsString()) {
+    THROW_TYPE_ERROR("Usage: ProbeAsync(path, callback)");
+  }
+  REQ_FUN_ARG(1, callback);
+
+  Nan::Utf8String path(info[0]);
+  Nan::AsyncQueueWorker(new ProbeWorker(new Nan::Callback(callback), *path));
+}
+
+NAN_METHOD(MetadataProbe::ProbeCacheSave) {
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    THROW_TYPE_ERROR("Argument 0 must be a path");
+  }
+
+  Nan::Utf8String path(info[0]);
+  if (cache.save(*path) < 0) {
+    return Nan::ThrowError("failed to save the probe cache");
+  }
+}
+
+/* ProbeCacheLoad(path): returns the number of entries read. */
+NAN_METHOD(MetadataProbe::ProbeCacheLoad) {
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    THROW_TYPE_ERROR("Argument 0 must be a path");
+  }
+
+  Nan::Utf8String path(info[0]);
+  int res = cache.load(*path);
+  if (res < 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "failed to load the probe cache (%d)", res);
+    return Nan::ThrowError(message);
+  }
+  info.GetReturnValue().Set(Nan::New<Number>(res));
+}
+
+NAN_METHOD(MetadataProbe::ProbeCacheSetCapacity) {
+  int capacity = info.Length() > 0 ? Nan::To<int32_t>(info[0]).FromMaybe(-1) : -1;
+  if (capacity < 0) {
+    return Nan::ThrowRangeError("capacity must be a non-negative number");
+  }
+  cache.setCapacity((size_t)capacity);
+}
+
+NAN_METHOD(MetadataProbe::ProbeCacheClear) {
+  cache.clear();
+}
+
+/* ProbeCacheStats(): {entries, capacity, hits, misses}. */
+NAN_METHOD(MetadataProbe::ProbeCacheStats) {
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("entries").ToLocalChecked(), Nan::New<Number>((double)cache.size()));
+  Nan::Set(result, Nan::New("capacity").ToLocalChecked(), Nan::New<Number>((double)cache.capacity()));
+  Nan::Set(result, Nan::New("hits").ToLocalChecked(), Nan::New<Number>((double)cache.hits()));
+  Nan::Set(result, Nan::New("misses").ToLocalChecked(), Nan::New<Number>((double)cache.misses()));
+  info.GetReturnValue().Set(result);
+}
+
+/* ProbeBatch([path, ...], concurrency, duration, callback) */
+NAN_METHOD(MetadataProbe::ProbeBatch) {
+  if (info.Length() != 4 || !info[0]->IsArray()) {
+    THROW_TYPE_ERROR("Usage: ProbeBatch([path, ...], concurrency, duration, callback)");
+  }
+
+  Local<Array> list = Local<Array>::Cast(info[0]);
+  int concurrency = Nan::To<int32_t>(info[1]).FromMaybe(1);
+  bool duration = Nan::To<bool>(info[2]).FromMaybe(false);
+  REQ_FUN_ARG(3, callback);
+
+  if (concurrency < 1) {
+    concurrency = 1;
+  }
+
+  ProbeBatchWorker *worker = new ProbeBatchWorker(new Nan::Callback(callback), concurrency, duration);
+  worker->paths.resize(list->Length());
+  for (uint32_t i = 0; i < list->Length(); i++) {
+    Local<Value> item = Nan::Get(list, i).ToLocalChecked();
+    if (!item->IsString()) {
+      delete worker;
+      THROW_TYPE_ERROR("Each path must be a string");
+    }
+    Nan::Utf8String path(item);
+    worker->paths[i] = *path;
+  }
+
+  Nan::AsyncQueueWorker(worker);
+}
@@ -0,0 +1,33 @@
+#if !defined( PROBE_H )
+#define PROBE_H
+
+#include <nan.h>
+#include "metadata_cache.h"
+
+/* Metadata queries answered from one process-wide MetadataCache: Probe(path),
+   ProbeCached(path), ProbeAsync(path, callback), ProbeCacheSave(path), ProbeCacheLoad(path), ProbeCacheSetCapacity(n),
+   ProbeCacheClear() and ProbeCacheStats(). ProbeBatch() checks many files
+   at once without the cache, see quickProbe(). */
+class MetadataProbe {
+ public:
+  static NAN_MODULE_INIT(Init);
+
+  /* {duration, links, channels, inputSampleRate, outputGain, preSkip,
+     mappingFamily, bitrate, vendor, tags}. */
+  static v8::Local<v8::Object> toObject(const FileMetadata &metadata);
+
+  static MetadataCache cache;
+
+ private:
+  static NAN_METHOD(Probe);
+  static NAN_METHOD(ProbeCached);
+  static NAN_METHOD(ProbeAsync);
+  static NAN_METHOD(ProbeCacheSave);
+  static NAN_METHOD(ProbeCacheLoad);
+  static NAN_METHOD(ProbeCacheSetCapacity);
+  static NAN_METHOD(ProbeCacheClear);
+  static NAN_METHOD(ProbeCacheStats);
+  static NAN_METHOD(ProbeBatch);
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "quick_probe.h"
+#include <stdio.h>
+#include <string.h>
+#include <ogg/ogg.h>
+
+/* The BOS pages of a normal Ogg Opus file fit in the first read; multiplexed
+   files may need more. */
+#define HEAD_BYTES 4096
+#define MAX_HEAD_BYTES 65536
+
+/* Finds the OpusHead among the BOS pages at the start of the file, as
+   op_test() does. */
+static int readHead(FILE *file, OpusHead *head) {
+  ogg_sync_state oy;
+  ogg_stream_state os;
+  ogg_sync_init(&oy);
+  ogg_stream_init(&os, -1);
+
+  int status = OP_FALSE;
+  long total = 0;
+  while (status == OP_FALSE) {
+    ogg_page og;
+    int ret = ogg_sync_pageout(&oy, &og);
+    if (ret < 0) {
+      continue;
+    }
+    if (ret == 0) {
+      long want = total == 0 ? HEAD_BYTES : total;
+      if (total >= MAX_HEAD_BYTES) {
+        status = OP_ENOTFORMAT;
+        break;
+      }
+      char *buffer = ogg_sync_buffer(&oy, want);
+      size_t bytes = fread(buffer, 1, (size_t)want, file);
+      if (bytes == 0) {
+        status = ferror(file) ? OP_EREAD : OP_ENOTFORMAT;
+        break;
+      }
+      /* Not worth parsing pages of something that is not Ogg at all. */
+      if (total == 0 && (bytes < 4 || memcmp(buffer, "OggS", 4) != 0)) {
+        status = OP_ENOTFORMAT;
+        break;
+      }
+      ogg_sync_wrote(&oy, (long)bytes);
+      total += (long)bytes;
+      continue;
+    }
+
+    ogg_packet op;
+    ogg_stream_reset_serialno(&os, ogg_page_serialno(&og));
+    ogg_stream_pagein(&os, &og);
+    if (ogg_stream_packetout(&os, &op) == 1) {
+      if (!op.b_o_s) {
+        /* Past the BOS pages without finding Opus. */
+        status = OP_ENOTFORMAT;
+      } else {
+        ret = opus_head_parse(head, op.packet, op.bytes);
+        if (ret != OP_ENOTFORMAT) {
+          status = ret;
+        }
+      }
+    }
+  }
+
+  ogg_stream_clear(&os);
+  ogg_sync_clear(&oy);
+  return status;
+}
+
+/* Checks the file with op_test_callbacks(), which reads the headers and
+   first audio page, and measures a single-link file with
+   op_test_pcm_total(), which adds the last page. The file is read through
+   stdio: a mapping would fault on files truncated while being probed. */
+static int testFile(const char *path, QuickProbe *result) {
+  OpusFileCallbacks cb;
+  void *stream = op_fopen(&cb, path, "rb");
+  if (stream == NULL) {
+    return OP_EREAD;
+  }
+
+  int error = 0;
+  OggOpusFile *of = op_test_callbacks(stream, &cb, NULL, 0, &error);
+  if (of == NULL) {
+    (*cb.close)(stream);
+    return error;
+  }
+  result->channels = op_head(of, 0)->channel_count;
+  ogg_int64_t duration = op_test_pcm_total(of);
+  result->duration = duration < 0 ? -1 : duration;
+  op_free(of);
+  return 0;
+}
+
+int quickProbe(const char *path, bool duration, QuickProbe *result) {
+  /* op_test_callbacks() parses the headers anyway, so it is the only check
+     when it has to run. */
+  if (duration) {
+    result->status = testFile(path, result);
+    return result->status;
+  }
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    result->status = OP_EREAD;
+    return result->status;
+  }
+
+  OpusHead head;
+  result->status = readHead(file, &head);
+  fclose(file);
+  if (result->status == 0) {
+    result->channels = head.channel_count;
+  }
+  return result->status;
+}
@@ -0,0 +1,25 @@
+#if !defined( QUICK_PROBE_H )
+#define QUICK_PROBE_H
+
+#include "../deps/opusfile/include/opusfile.h"
+
+/* Outcome of quickProbe() for one file. */
+struct QuickProbe {
+  QuickProbe() : status(OP_EREAD), channels(0), duration(-1) {}
+
+  /* 0 for Ogg Opus, otherwise OP_ENOTFORMAT, OP_EREAD, ... */
+  int status;
+  int channels;
+  /* Samples per channel at 48 kHz, or -1 when not asked for or not found. */
+  ogg_int64_t duration;
+};
+
+/* Checks path for an Ogg Opus stream from its first pages only. With
+   duration the check is op_test_callbacks(), which also reads the first
+   audio page, and a single-link file is measured through
+   op_test_pcm_total(), which adds its last page; chained files report -1.
+   Never sets up a decoder, so it is cheap enough to run over whole
+   directories. Safe to call from any thread. */
+int quickProbe(const char *path, bool duration, QuickProbe *result);
+
+#endif
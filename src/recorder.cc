@@ -0,0 +1,654 @@
+#include "recorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef max
+#define max(x, y) ((x) > (y)) ? (x) : (y)
+#endif
+#ifndef min
+#define min(x, y) ((x) < (y)) ? (x) : (y)
+#endif
+
+typedef struct {
+    unsigned char *data;
+    int maxlen;
+    int pos;
+} Packet;
+
+const int comment_padding = 512;
+
+/* Largest frame the recorder accepts: 60 ms of stereo at 48 kHz. */
+#define MAX_FRAME_SAMPLES (2880 * 2)
+
+static int write_uint32(Packet *p, ogg_uint32_t val) {
+    if (p->pos > p->maxlen - 4) {
+        return 0;
+    }
+    p->data[p->pos  ] = (val    ) & 0xFF;
+    p->data[p->pos+1] = (val>> 8) & 0xFF;
+    p->data[p->pos+2] = (val>>16) & 0xFF;
+    p->data[p->pos+3] = (val>>24) & 0xFF;
+    p->pos += 4;
+    return 1;
+}
+
+static int write_uint16(Packet *p, ogg_uint16_t val) {
+    if (p->pos > p->maxlen-2) {
+        return 0;
+    }
+    p->data[p->pos  ] = (val    ) & 0xFF;
+    p->data[p->pos+1] = (val>> 8) & 0xFF;
+    p->pos += 2;
+    return 1;
+}
+
+static int write_chars(Packet *p, const unsigned char *str, int nb_chars)
+{
+    int i;
+    if (p->pos>p->maxlen-nb_chars)
+        return 0;
+    for (i=0;i<nb_chars;i++)
+        p->data[p->pos++] = str[i];
+    return 1;
+}
+
+Recorder::Recorder()
+  : max_ogg_delay(0), rate(16000), channels(1), frame_size(960), application(OPUS_APPLICATION_AUDIO),
+    coding_rate(16000), coding_frame(960), resampling(0), eos_written(0), resampled(0),
+    _encoder(0), default_complexity(0), _packet(0), _padded(0),
+    _comments(0), _comments_length(0), first_frame_allocations(0) {
+  memset(&os, 0, sizeof(ogg_stream_state));
+  cleanup();
+}
+
+Recorder::~Recorder() {
+  cleanup();
+
+  ogg_stream_clear(&os);
+
+  if (_encoder) {
+    opus_encoder_destroy(_encoder);
+    _encoder = 0;
+  }
+
+  if (_packet) {
+    free(_packet);
+    _packet = 0;
+  }
+
+  free(_padded);
+  free(_comments);
+}
+
+int Recorder::frameBytes() const {
+  return frame_size * channels * 2;
+}
+
+opus_int32 Recorder::codingRate(opus_int32 rate) {
+  if (rate > 24000) {
+    return 48000;
+  } else if (rate > 16000) {
+    return 24000;
+  } else if (rate > 12000) {
+    return 16000;
+  } else if (rate > 8000) {
+    return 12000;
+  }
+  return 8000;
+}
+
+/* Allocations made on the calling thread since the first frame of the
+   current file, by anything: the encoder, the Ogg stream, the page sink or
+   whoever drives the recorder. -1 when nothing is counting them. */
+long long Recorder::frameAllocations() const {
+  long long now = threadAllocations();
+  return now < 0 ? -1 : now - first_frame_allocations;
+}
+
+/* Finishes the current file. The encoder, Ogg stream storage and scratch
+   buffers are kept so that the next init() on this recorder can reuse them. */
+void Recorder::cleanup() {
+  sink.close();
+
+  _packetId = -1;
+  bytes_written = 0;
+  pages_out = 0;
+  total_samples = 0;
+  resampled = 0;
+  eos_written = 0;
+  enc_granulepos = 0;
+  size_segments = 0;
+  last_segments = 0;
+  last_granulepos = 0;
+  memset(&inopt, 0, sizeof(oe_enc_opt));
+  memset(&header, 0, sizeof(OpusHeader));
+  memset(&op, 0, sizeof(ogg_packet));
+  memset(&og, 0, sizeof(ogg_page));
+
+  // fprintf(stderr, "Recording ends!!!\n");
+}
+
+int opus_header_to_packet_(const OpusHeader *h, unsigned char *packet, int len) {
+    int i;
+    Packet p;
+    unsigned char ch;
+
+    p.data = packet;
+    p.maxlen = len;
+    p.pos = 0;
+    if (len < 19) {
+        return 0;
+    }
+    if (!write_chars(&p, (const unsigned char *)"OpusHead", 8)) {
+        return 0;
+    }
+
+    ch = 1;
+    if (!write_chars(&p, &ch, 1)) {
+        return 0;
+    }
+
+    ch = h->channels;
+    if (!write_chars(&p, &ch, 1)) {
+        return 0;
+    }
+
+    if (!write_uint16(&p, h->preskip)) {
+        return 0;
+    }
+
+    if (!write_uint32(&p, h->input_sample_rate)) {
+        return 0;
+    }
+
+    if (!write_uint16(&p, h->gain)) {
+        return 0;
+    }
+
+    ch = h->channel_mapping;
+    if (!write_chars(&p, &ch, 1)) {
+        return 0;
+    }
+
+    if (h->channel_mapping != 0) {
+        ch = h->nb_streams;
+        if (!write_chars(&p, &ch, 1)) {
+            return 0;
+        }
+
+        ch = h->nb_coupled;
+        if (!write_chars(&p, &ch, 1)) {
+            return 0;
+        }
+
+        /* Multi-stream support */
+        for (i = 0; i < h->channels; i++) {
+            if (!write_chars(&p, &h->stream_map[i], 1)) {
+                return 0;
+            }
+        }
+    }
+
+    return p.pos;
+}
+
+#define writeint(buf, base, val) do { buf[base + 3] = ((val) >> 24) & 0xff; \
+buf[base + 2]=((val) >> 16) & 0xff; \
+buf[base + 1]=((val) >> 8) & 0xff; \
+buf[base] = (val) & 0xff; \
+} while(0)
+
+static void comment_init(char **comments, int *length, const char *vendor_string) {
+    /* The 'vendor' field should be the actual encoding library used */
+    int vendor_length = strlen(vendor_string);
+    int user_comment_list_length = 0;
+    int len = 8 + 4 + vendor_length + 4;
+    char *p = (char *)malloc(len);
+    memcpy(p, "OpusTags", 8);
+    writeint(p, 8, vendor_length);
+    memcpy(p + 12, vendor_string, vendor_length);
+    writeint(p, 12 + vendor_length, user_comment_list_length);
+    *length = len;
+    *comments = p;
+}
+
+static void comment_pad(char **comments, int* length, int amount) {
+    if (amount > 0) {
+        char *p = *comments;
+        /* Make sure there is at least amount worth of padding free, and round up to the maximum that fits in the current ogg segments */
+        int newlen = (*length + amount + 255) / 255 * 255 - 1;
+        p = static_cast<char*>(realloc(p, newlen));
+        int i = 0;
+        for (i = *length; i < newlen; i++) {
+            p[i] = 0;
+        }
+        *comments = p;
+        *length = newlen;
+    }
+}
+
+static int writeOggPage(ogg_page *page, PageSink *sink) {
+    return (int)sink->write(page);
+}
+
+int Recorder::init(const char *path, const RecorderOptions &options) {
+  cleanup();
+
+  /* The encoder can only be reset in place if it was created for the same
+     rate, channel count and application. */
+  if (_encoder && (options.rate != rate || options.channels != channels || options.application != application)) {
+    opus_encoder_destroy(_encoder);
+    _encoder = 0;
+  }
+
+  max_ogg_delay = options.max_ogg_delay;
+  rate = options.rate;
+  channels = options.channels;
+  application = options.application;
+  /* Input frames are rounded up to whole samples at rates like 44100 Hz,
+     where 2.5 ms is not one. */
+  frame_size = (options.frame_duration * rate + 47999) / 48000;
+
+  // fprintf(stderr, "in Recorder, path: %s\n", path);
+  if (!path) {
+    return 0;
+  }
+
+  if (!sink.open(path, options.flush_threshold)) {
+    return 0;
+  }
+
+  inopt.rate = rate;
+  inopt.gain = 0;
+  inopt.endianness = 0;
+  inopt.copy_comments = 0;
+  inopt.rawmode = 1;
+  inopt.ignorelength = 1;
+  inopt.samplesize = 16;
+  inopt.channels = channels;
+  inopt.skip = 0;
+
+  /* The tags only carry the vendor string, so they are built once per
+     recorder rather than once per file. */
+  if (!_comments) {
+    comment_init(&_comments, &_comments_length, opus_get_version_string());
+    comment_pad(&_comments, &_comments_length, comment_padding);
+  }
+  inopt.comments = _comments;
+  inopt.comments_length = _comments_length;
+
+  coding_rate = codingRate(rate);
+  coding_frame = options.frame_duration * coding_rate / 48000;
+  resampling = rate != coding_rate;
+  if (resampling) {
+    if (!resampler.init(rate, coding_rate, channels)) {
+      fprintf(stderr, "Error cannot resample from %d Hz\n", (int)rate);
+      return 0;
+    }
+    /* One input frame and the resampler tail on top of a held-back encoder
+       frame, with room to pad the last one. */
+    size_t in_size = (size_t)frame_size * channels;
+    size_t out_size = (size_t)(resampler.maxOutput(frame_size) + resampler.maxOutput(0) + 2 * coding_frame) * channels;
+    if (resample_in.size() < in_size) {
+      resample_in.resize(in_size);
+    }
+    if (resampled_pcm.size() < out_size) {
+      resampled_pcm.resize(out_size);
+    }
+  }
+
+  header.channels = channels;
+  header.channel_mapping = 0;
+  header.input_sample_rate = rate;
+  header.gain = inopt.gain;
+  header.nb_streams = 1;
+
+  int result = OPUS_OK;
+  if (_encoder) {
+    result = opus_encoder_ctl(_encoder, OPUS_RESET_STATE);
+  } else {
+    _encoder = opus_encoder_create(coding_rate, channels, application, &result);
+    if (result == OPUS_OK) {
+      result = opus_encoder_ctl(_encoder, OPUS_GET_COMPLEXITY(&default_complexity));
+    }
+  }
+  if (result != OPUS_OK) {
+    fprintf(stderr, "Error cannot create encoder: %s\n", opus_strerror(result));
+    return 0;
+  }
+
+  min_bytes = max_frame_bytes = (1275 * 3 + 7) * header.nb_streams;
+  if (!_packet) {
+    _packet = static_cast<unsigned char*>(malloc(max_frame_bytes));
+  }
+  if (!_padded) {
+    _padded = static_cast<unsigned char*>(malloc(MAX_FRAME_SAMPLES * 2));
+  }
+
+  result = opus_encoder_ctl(_encoder, OPUS_SET_BITRATE(options.bitrate));
+  if (result != OPUS_OK) {
+    fprintf(stderr, "Error OPUS_SET_BITRATE returned: %s\n", opus_strerror(result));
+    return 0;
+  }
+
+  result = opus_encoder_ctl(_encoder, OPUS_SET_VBR(options.vbr));
+  if (result != OPUS_OK) {
+    fprintf(stderr, "Error OPUS_SET_VBR returned: %s\n", opus_strerror(result));
+    return 0;
+  }
+
+  result = opus_encoder_ctl(_encoder, OPUS_SET_VBR_CONSTRAINT(options.cvbr));
+  if (result != OPUS_OK) {
+    fprintf(stderr, "Error OPUS_SET_VBR_CONSTRAINT returned: %s\n", opus_strerror(result));
+    return 0;
+  }
+
+  result = opus_encoder_ctl(_encoder,
+                            OPUS_SET_COMPLEXITY(options.complexity >= 0 ? options.complexity : default_complexity));
+  if (result != OPUS_OK) {
+    fprintf(stderr, "Error OPUS_SET_COMPLEXITY returned: %s\n", opus_strerror(result));
+    return 0;
+  }
+
+#ifdef OPUS_SET_LSB_DEPTH
+  result = opus_encoder_ctl(_encoder, OPUS_SET_LSB_DEPTH(max(8, min(24, inopt.samplesize))));
+  if (result != OPUS_OK) {
+    fprintf(stderr, "Warning OPUS_SET_LSB_DEPTH returned: %s\n", opus_strerror(result));
+  }
+#endif
+
+  opus_int32 lookahead;
+  result = opus_encoder_ctl(_encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+  if (result != OPUS_OK) {
+    fprintf(stderr, "Error OPUS_GET_LOOKAHEAD returned: %s\n", opus_strerror(result));
+    return 0;
+  }
+
+  inopt.skip += lookahead;
+  header.preskip = (int)(inopt.skip * (48000.0 / coding_rate));
+  inopt.extraout = (int)(header.preskip * (rate / 48000.0));
+
+  return writeHeaders();
+}
+
+/* Starts a file whose packets come ready-made from another Ogg Opus stream
+   (see writePacket); no encoder is involved. The OpusHead is rewritten from
+   head and the OpusTags are replaced with our own. */
+int Recorder::initPassthrough(const char *path, const RecorderOptions &options, const OpusHeader &head) {
+  cleanup();
+
+  max_ogg_delay = options.max_ogg_delay;
+  coding_rate = 48000;
+  resampling = 0;
+
+  if (!path || !sink.open(path, options.flush_threshold)) {
+    return 0;
+  }
+
+  if (!_comments) {
+    comment_init(&_comments, &_comments_length, opus_get_version_string());
+    comment_pad(&_comments, &_comments_length, comment_padding);
+  }
+  inopt.comments = _comments;
+  inopt.comments_length = _comments_length;
+
+  header = head;
+
+  return writeHeaders();
+}
+
+/* Starts the Ogg stream and writes the OpusHead and OpusTags pages. */
+int Recorder::writeHeaders() {
+  int result;
+
+  if (os.body_data) {
+    result = ogg_stream_reset_serialno(&os, rand());
+  } else {
+    result = ogg_stream_init(&os, rand());
+  }
+  if (result == -1) {
+    fprintf(stderr, "Error: stream init failed");
+    return 0;
+  }
+
+  unsigned char header_data[300];
+  int packet_size = opus_header_to_packet_(&header, header_data, sizeof(header_data));
+  op.packet = header_data;
+  op.bytes = packet_size;
+  op.b_o_s = 1;
+  op.e_o_s = 0;
+  op.granulepos = 0;
+  op.packetno = 0;
+  ogg_stream_packetin(&os, &op);
+
+  while ((result = ogg_stream_flush(&os, &og))) {
+    if (!result) {
+      break;
+    }
+
+    int pageBytesWritten = writeOggPage(&og, &sink);
+    if (pageBytesWritten != og.header_len + og.body_len) {
+      fprintf(stderr, "Error: failed writing header to output stream");
+      return 0;
+    }
+    bytes_written += pageBytesWritten;
+    pages_out++;
+  }
+
+  op.packet = (unsigned char *)inopt.comments;
+  op.bytes = inopt.comments_length;
+  op.b_o_s = 0;
+  op.e_o_s = 0;
+  op.granulepos = 0;
+  op.packetno = 1;
+  ogg_stream_packetin(&os, &op);
+
+  while ((result = ogg_stream_flush(&os, &og))) {
+    if (result == 0) {
+      break;
+    }
+
+    int writtenPageBytes = writeOggPage(&og, &sink);
+    if (writtenPageBytes != og.header_len + og.body_len) {
+      fprintf(stderr, "Error: failed writing header to output stream");
+      return 0;
+    }
+
+    bytes_written += writtenPageBytes;
+    pages_out++;
+  }
+
+  return 1;
+}
+
+int Recorder::writeFrame(uint8_t *framePcmBytes, unsigned int frameByteCount) {
+    int cur_frame_size = frame_size;
+
+    opus_int32 nb_samples = frameByteCount / (2 * channels);
+    total_samples += nb_samples;
+    int eos = nb_samples < frame_size;
+    int duration = 0;
+    int nbBytes = 0;
+
+    if (resampling) {
+        return writeResampled((const opus_int16 *)framePcmBytes, nb_samples, eos);
+    }
+
+    /* An empty last frame is still encoded, as silence, so that the stream
+       ends on a real packet; its granule position trims it away. */
+    uint8_t *paddedFrameBytes = framePcmBytes;
+
+    if (nb_samples < cur_frame_size) {
+        paddedFrameBytes = _padded;
+        if (nb_samples > 0) {
+            memcpy(paddedFrameBytes, framePcmBytes, nb_samples * channels * 2);
+        }
+        memset(paddedFrameBytes + nb_samples * channels * 2, 0, (cur_frame_size - nb_samples) * channels * 2);
+    }
+
+    nbBytes = opus_encode(_encoder, (opus_int16 *)paddedFrameBytes, cur_frame_size, _packet, max_frame_bytes);
+
+    if (nbBytes < 0) {
+        fprintf(stderr, "Encoding failed: %s. Aborting.\n", opus_strerror(nbBytes));
+        return 0;
+    }
+
+    duration = cur_frame_size * 48000 / coding_rate;
+    min_bytes = min(nbBytes, min_bytes);
+
+    ogg_int64_t granulepos = enc_granulepos + duration;
+    if (eos) {
+        granulepos = ((total_samples * 48000 + rate - 1) / rate) + header.preskip;
+    }
+
+    return writePacket(_packet, nbBytes, duration, granulepos, eos);
+}
+
+/* writeFrame at an input rate Opus does not code at. The frame goes through
+   the resampler and every whole encoder frame that is ready is encoded, so
+   packets need not line up with input frames. The newest frame is held back
+   until more arrives: at the end of the stream it, with the resampler tail
+   and padding, goes out as the final packet, so the stream always ends on
+   an encoded frame. */
+int Recorder::writeResampled(const opus_int16 *pcm, int nb_samples, int eos) {
+    float *in = resample_in.empty() ? NULL : &resample_in[0];
+    float *out = &resampled_pcm[0];
+    for (int i = 0; i < nb_samples * channels; i++) {
+        in[i] = pcm[i] * (1.0f / 32768);
+    }
+    resampled += resampler.process(in, nb_samples, out + resampled * channels);
+    if (eos) {
+        resampled += resampler.flush(out + resampled * channels);
+    }
+
+    int offset = 0;
+    while (resampled - offset > coding_frame) {
+        if (!encodeFloat(out + offset * channels, 0)) {
+            return 0;
+        }
+        offset += coding_frame;
+    }
+
+    if (eos) {
+        int left = resampled - offset;
+        memset(out + (offset + left) * channels, 0, (coding_frame - left) * channels * sizeof(float));
+        if (!encodeFloat(out + offset * channels, 1)) {
+            return 0;
+        }
+        offset = resampled;
+    }
+
+    memmove(out, out + offset * channels, (resampled - offset) * channels * sizeof(float));
+    resampled -= offset;
+    return 1;
+}
+
+/* Encodes one coding_frame of resampled float PCM as the next packet. */
+int Recorder::encodeFloat(const float *pcm, int eos) {
+    int nbBytes = opus_encode_float(_encoder, pcm, coding_frame, _packet, max_frame_bytes);
+    if (nbBytes < 0) {
+        fprintf(stderr, "Encoding failed: %s. Aborting.\n", opus_strerror(nbBytes));
+        return 0;
+    }
+    min_bytes = min(nbBytes, min_bytes);
+
+    int duration = coding_frame * 48000 / coding_rate;
+    ogg_int64_t granulepos = enc_granulepos + duration;
+    if (eos) {
+        granulepos = ((total_samples * 48000 + rate - 1) / rate) + header.preskip;
+    }
+    return writePacket(_packet, nbBytes, duration, granulepos, eos);
+}
+
+/* Queues one Opus packet lasting `duration` 48 kHz samples and writes out
+   whatever pages that completes. granulepos is the packet's end position;
+   eos marks the last packet of the stream and flushes it. */
+int Recorder::writePacket(const unsigned char *data, int bytes, int duration, ogg_int64_t granulepos, int eos) {
+    _packetId++;
+    enc_granulepos += duration;
+    eos_written |= eos;
+    size_segments = bytes / 255 + 1;
+
+    while ((((size_segments <= 255) && (last_segments + size_segments > 255)) || (enc_granulepos - last_granulepos > max_ogg_delay)) && ogg_stream_flush_fill(&os, &og, 255 * 255)) {
+        if (ogg_page_packets(&og) != 0) {
+            last_granulepos = ogg_page_granulepos(&og);
+        }
+
+        last_segments -= og.header[26];
+        int writtenPageBytes = writeOggPage(&og, &sink);
+        if (writtenPageBytes != og.header_len + og.body_len) {
+            fprintf(stderr, "Error: failed writing data to output stream\n");
+            return 0;
+        }
+        bytes_written += writtenPageBytes;
+
+        pages_out++;
+    }
+
+    op.packet = const_cast<unsigned char *>(data);
+    op.bytes = bytes;
+    op.b_o_s = 0;
+    op.e_o_s = eos;
+    op.granulepos = granulepos;
+    op.packetno = 2 + _packetId;
+    ogg_stream_packetin(&os, &op);
+    last_segments += size_segments;
+
+    while ((op.e_o_s || (enc_granulepos + duration - last_granulepos > max_ogg_delay) || (last_segments >= 255)) ? ogg_stream_flush_fill(&os, &og, 255 * 255) : ogg_stream_pageout_fill(&os, &og, 255 * 255)) {
+        if (ogg_page_packets(&og) != 0) {
+            last_granulepos = ogg_page_granulepos(&og);
+        }
+        last_segments -= og.header[26];
+        int writtenPageBytes = writeOggPage(&og, &sink);
+        if (writtenPageBytes != og.header_len + og.body_len) {
+            fprintf(stderr, "Error: failed writing data to output stream\n");
+            return 0;
+        }
+        bytes_written += writtenPageBytes;
+        pages_out++;
+    }
+
+    if (_packetId == 0) {
+        first_frame_allocations = threadAllocations();
+    }
+
+    // fprintf(stderr, "last byte_written is %lld\n", bytes_written);
+    return 1;
+}
+
+/* Flushes the packets still held back by max_ogg_delay and the bytes held in
+   the page sink. Call once after the last frame and before cleanup(),
+   otherwise the tail of the stream is lost. */
+int Recorder::finish() {
+    /* A stream that ended on a whole input frame has no packet marked as
+       its end yet, and without one the last page's granule position cannot
+       trim the encoder padding. Send an empty frame, which goes out as a
+       padded one (or as the resampler tail) with the end-of-stream flag. */
+    if (!eos_written && total_samples > 0) {
+        if (!writeFrame(NULL, 0)) {
+            return 0;
+        }
+    }
+
+    while (ogg_stream_flush_fill(&os, &og, 255 * 255)) {
+        if (ogg_page_packets(&og) != 0) {
+            last_granulepos = ogg_page_granulepos(&og);
+        }
+        last_segments -= og.header[26];
+        int writtenPageBytes = writeOggPage(&og, &sink);
+        if (writtenPageBytes != og.header_len + og.body_len) {
+            fprintf(stderr, "Error: failed writing data to output stream\n");
+            return 0;
+        }
+        bytes_written += writtenPageBytes;
+        pages_out++;
+    }
+
+    if (!sink.flush()) {
+        fprintf(stderr, "Error: failed writing data to output stream\n");
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,156 @@
+#if !defined( RECORDER_H )
+#define RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <opus/opus.h>
+#include <ogg/ogg.h>
+#include <vector>
+#include "alloc_count.h"
+#include "page_sink.h"
+#include "resampler.h"
+
+typedef struct {
+    int version;
+    int channels; /* Number of channels: 1..255 */
+    int preskip;
+    ogg_uint32_t input_sample_rate;
+    int gain; /* in dB S7.8 should be zero whenever possible */
+    int channel_mapping;
+    /* The rest is only used if channel_mapping != 0 */
+    int nb_streams;
+    int nb_coupled;
+    unsigned char stream_map[255];
+} OpusHeader;
+
+typedef struct {
+    void *readdata;
+    opus_int64 total_samples_per_channel;
+    int rawmode;
+    int channels;
+    long rate;
+    int gain;
+    int samplesize;
+    int endianness;
+    char *infilename;
+    int ignorelength;
+    int skip;
+    int extraout;
+    char *comments;
+    int comments_length;
+    int copy_comments;
+} oe_enc_opt;
+
+int opus_header_to_packet_(const OpusHeader *h, unsigned char *packet, int len);
+
+/* Per-job settings for a Recorder. */
+struct RecorderOptions {
+  RecorderOptions()
+    : rate(16000), channels(1), bitrate(16000), complexity(-1), vbr(1), cvbr(0),
+      frame_duration(2880), application(OPUS_APPLICATION_AUDIO),
+      max_ogg_delay(0), flush_threshold(64 * 1024) {}
+
+  /* Input sample rate, 8000 to 192000. Rates Opus does not code at are
+     resampled to the next one up (see Recorder::codingRate). */
+  opus_int32 rate;
+  int channels;
+  opus_int32 bitrate;
+  /* 0-10, or -1 to keep the libopus default. Lower is faster. */
+  int complexity;
+  int vbr;
+  int cvbr;
+  /* Frame length in 48 kHz samples: 120 (2.5 ms) up to 2880 (60 ms). */
+  int frame_duration;
+  /* OPUS_APPLICATION_VOIP, _AUDIO or _RESTRICTED_LOWDELAY. */
+  int application;
+
+  /* Most audio, in 48 kHz samples, that may be buffered before an Ogg page
+     is flushed. 0 puts every packet on its own page for low latency; larger
+     values pack up to 255 segments per page and save container overhead. */
+  int max_ogg_delay;
+
+  /* Output bytes gathered before they are written out in one call. 0 writes
+     each page as soon as it is complete. */
+  int flush_threshold;
+};
+
+/* Ogg Opus encoder writing to a single output file. Every piece of state
+   lives in the instance, so independent recorders can run concurrently on
+   different threads. A recorder is not safe to share between threads. */
+class Recorder {
+ public:
+  Recorder();
+  ~Recorder();
+
+  int init(const char *path, const RecorderOptions &options = RecorderOptions());
+  int initPassthrough(const char *path, const RecorderOptions &options, const OpusHeader &head);
+  int writeFrame(uint8_t *framePcmBytes, unsigned int frameByteCount);
+  int writePacket(const unsigned char *data, int bytes, int duration, ogg_int64_t granulepos, int eos);
+  int finish();
+  void cleanup();
+
+  int frameBytes() const;
+  /* The rate the encoder runs at for an input rate: the lowest of 8000,
+     12000, 16000, 24000 and 48000 that is not below it, or 48000. */
+  static opus_int32 codingRate(opus_int32 rate);
+  opus_int64 bytesWritten() const { return bytes_written; }
+  opus_int64 pagesOut() const { return pages_out; }
+  long long writeCalls() const { return sink.writeCalls(); }
+  /* Allocations on this thread since the first frame of the current file;
+     0 in steady state, -1 unless threadAllocations() is counting. */
+  long long frameAllocations() const;
+
+ private:
+  Recorder(const Recorder&);
+  Recorder& operator=(const Recorder&);
+
+  int writeHeaders();
+  int writeResampled(const opus_int16 *pcm, int nb_samples, int eos);
+  int encodeFloat(const float *pcm, int eos);
+
+  int max_ogg_delay;
+  opus_int32 rate;
+  int channels;
+  int frame_size;
+  int application;
+  opus_int32 coding_rate;
+  /* Encoder frame length at coding_rate; frame_size is at the input rate. */
+  int coding_frame;
+  /* Set when rate != coding_rate. Input frames are converted to float and
+     resampled into resampled_pcm, which holds resampled samples per channel
+     until they make up whole encoder frames. */
+  int resampling;
+  /* Set once the packet marked as the end of the stream is queued. */
+  int eos_written;
+  Resampler resampler;
+  std::vector<float> resample_in;
+  std::vector<float> resampled_pcm;
+  int resampled;
+  ogg_int32_t _packetId;
+  OpusEncoder *_encoder;
+  /* libopus's complexity for a new encoder, put back when a reused one is
+     given none; OPUS_RESET_STATE leaves the last file's setting. */
+  opus_int32 default_complexity;
+  uint8_t *_packet;
+  uint8_t *_padded;
+  char *_comments;
+  int _comments_length;
+  long long first_frame_allocations;
+  ogg_stream_state os;
+  PageSink sink;
+  oe_enc_opt inopt;
+  OpusHeader header;
+  opus_int32 min_bytes;
+  int max_frame_bytes;
+  ogg_packet op;
+  ogg_page og;
+  opus_int64 bytes_written;
+  opus_int64 pages_out;
+  opus_int64 total_samples;
+  ogg_int64_t enc_granulepos;
+  ogg_int64_t last_granulepos;
+  int size_segments;
+  int last_segments;
+};
+
+#endif
@@ -0,0 +1,233 @@
+#include "resampler.h"
+#include <math.h>
+#include <string.h>
+
+#if !defined(M_PI)
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RESAMPLER_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#endif
+
+/* Taps per phase without downsampling; downsampling widens the filter by
+   the rate ratio, up to MAX_TAPS. Both stay multiples of 8 for dot(). */
+#define BASE_TAPS 48
+#define MAX_TAPS 1024
+/* Rows in the coefficient table before neighbouring rows are interpolated
+   instead, as for 44100 -> 44101 Hz. */
+#define MAX_PHASES 256
+/* Input samples per channel taken into the history per pass. */
+#define BLOCK_SAMPLES 1024
+/* Passband edge as a fraction of the lower Nyquist rate, and the Kaiser
+   window shape: about 80 dB of stopband. */
+#define ROLLOFF 0.88
+#define KAISER_BETA 8.0
+
+/* Zeroth order modified Bessel function of the first kind. */
+static double besselI0(double x) {
+  double sum = 1;
+  double term = 1;
+  for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+static opus_int32 gcd(opus_int32 a, opus_int32 b) {
+  while (b != 0) {
+    opus_int32 t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* Sum of a[i] * b[i] over n, a multiple of 8. */
+static float dot(const float *a, const float *b, int n) {
+#if defined(RESAMPLER_SSE)
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (int i = 0; i < n; i += 8) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  acc0 = _mm_add_ps(acc0, acc1);
+  acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+  acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+  return _mm_cvtss_f32(acc0);
+#elif defined(RESAMPLER_NEON)
+  float32x4_t acc0 = vdupq_n_f32(0);
+  float32x4_t acc1 = vdupq_n_f32(0);
+  for (int i = 0; i < n; i += 8) {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  acc0 = vaddq_f32(acc0, acc1);
+  float32x2_t sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+  return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+  float acc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  for (int i = 0; i < n; i += 8) {
+    for (int j = 0; j < 8; j++) {
+      acc[j] += a[i + j] * b[i + j];
+    }
+  }
+  return ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+#endif
+}
+
+Resampler::Resampler()
+  : channels(0), up(0), down(0), phases(0), taps(0), capacity(0), fill(0), pos(0), frac(0),
+    consumed(0), produced(0) {}
+
+int Resampler::init(opus_int32 inRate, opus_int32 outRate, int channels_) {
+  if (inRate < 1000 || inRate > 384000 || outRate < 1000 || outRate > 384000 || channels_ < 1) {
+    return 0;
+  }
+
+  opus_int32 divisor = gcd(inRate, outRate);
+  if (outRate / divisor != up || inRate / divisor != down) {
+    up = outRate / divisor;
+    down = inRate / divisor;
+    phases = up <= MAX_PHASES ? up : MAX_PHASES;
+
+    double cutoff = up < down ? (double)up / down : 1.0;
+    taps = (int)ceil(BASE_TAPS / cutoff);
+    taps = (taps + 7) / 8 * 8;
+    if (taps > MAX_TAPS) {
+      taps = MAX_TAPS;
+    }
+
+    size_t size = (size_t)(phases + 1) * taps;
+    filter.resize(size);
+
+    /* Row p holds the taps for output times p / phases past an input
+       sample, covering the taps / 2 input samples on either side. */
+    int half = taps / 2;
+    double fc = cutoff * ROLLOFF;
+    double norm = besselI0(KAISER_BETA);
+    for (int p = 0; p <= phases; p++) {
+      float *row = &filter[(size_t)p * taps];
+      double sum = 0;
+      for (int k = 0; k < taps; k++) {
+        double d = (k - (half - 1)) - (double)p / phases;
+        double x = d / half;
+        double window = x * x < 1 ? besselI0(KAISER_BETA * sqrt(1 - x * x)) / norm : 0;
+        double sinc = d == 0 ? 1 : sin(M_PI * fc * d) / (M_PI * fc * d);
+        row[k] = (float)(sinc * window);
+        sum += row[k];
+      }
+      /* Unity gain at DC for every phase. */
+      for (int k = 0; k < taps; k++) {
+        row[k] = (float)(row[k] / sum);
+      }
+    }
+  }
+
+  channels = channels_;
+  capacity = taps + BLOCK_SAMPLES;
+  size_t size = (size_t)capacity * channels;
+  history.assign(size, 0.0f);
+
+  /* Start with silence before the first sample, so the first output is
+     centred on it. */
+  fill = taps / 2 - 1;
+  pos = taps / 2 - 1;
+  frac = 0;
+  consumed = 0;
+  produced = 0;
+  return 1;
+}
+
+int Resampler::maxOutput(int samples) const {
+  return (int)(((opus_int64)(samples + taps) * up + down - 1) / down) + 1;
+}
+
+/* Writes every output sample whose window is in the history, up to a total
+   of limit, and returns how many. */
+int Resampler::drain(float *out, opus_int64 limit) {
+  int half = taps / 2;
+  int count = 0;
+  while (pos + half < fill && produced < limit) {
+    opus_int32 index = (opus_int32)((opus_int64)frac * phases / up);
+    opus_int32 rem = (opus_int32)((opus_int64)frac * phases % up);
+    const float *row = &filter[(size_t)index * taps];
+    for (int c = 0; c < channels; c++) {
+      const float *x = &history[(size_t)c * capacity + pos - (half - 1)];
+      float y = dot(row, x, taps);
+      if (rem != 0) {
+        float next = dot(row + taps, x, taps);
+        y += (next - y) * ((float)rem / up);
+      }
+      out[count * channels + c] = y;
+    }
+    count++;
+    produced++;
+    frac += down;
+    pos += frac / up;
+    frac %= up;
+  }
+  return count;
+}
+
+/* Drops the history that no later output can reach. */
+void Resampler::compact() {
+  int start = pos - (taps / 2 - 1);
+  if (start <= 0) {
+    return;
+  }
+  if (start > fill) {
+    start = fill;
+  }
+  for (int c = 0; c < channels; c++) {
+    float *h = &history[(size_t)c * capacity];
+    memmove(h, h + start, (fill - start) * sizeof(float));
+  }
+  fill -= start;
+  pos -= start;
+}
+
+int Resampler::process(const float *in, int samples, float *out) {
+  int count = 0;
+  while (samples > 0) {
+    int n = capacity - fill;
+    if (n > samples) {
+      n = samples;
+    }
+    for (int c = 0; c < channels; c++) {
+      float *h = &history[(size_t)c * capacity + fill];
+      for (int i = 0; i < n; i++) {
+        h[i] = in[i * channels + c];
+      }
+    }
+    fill += n;
+    in += n * channels;
+    samples -= n;
+    consumed += n;
+
+    count += drain(out + count * channels, (opus_int64)1 << 62);
+    compact();
+  }
+  return count;
+}
+
+int Resampler::flush(float *out) {
+  opus_int64 target = (consumed * up + down - 1) / down;
+  int count = 0;
+  while (produced < target) {
+    int n = capacity - fill;
+    for (int c = 0; c < channels; c++) {
+      memset(&history[(size_t)c * capacity + fill], 0, n * sizeof(float));
+    }
+    fill += n;
+    count += drain(out + count * channels, target);
+    compact();
+  }
+  return count;
+}
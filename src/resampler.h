@@ -0,0 +1,62 @@
+#if !defined( RESAMPLER_H )
+#define RESAMPLER_H
+
+#include <vector>
+#include <opus/opus.h>
+
+/* Streaming polyphase resampler for interleaved float PCM between any two
+   rates. The filter is a Kaiser-windowed sinc, cut off below the lower of
+   the two Nyquist rates, with one row of taps per output phase; when the
+   rates reduce to more phases than fit in the table, neighbouring rows are
+   interpolated. Output sample j lands exactly on input time j * inRate /
+   outRate, so there is no delay to compensate, and flush() brings out the
+   tail once the input ends. */
+class Resampler {
+ public:
+  Resampler();
+
+  /* Prepares to convert `channels` channels from inRate to outRate, both
+     between 1000 and 384000 Hz, and drops any previous stream. Storage from
+     an earlier init() is reused where it is large enough. Returns 0 if the
+     arguments are out of range. */
+  int init(opus_int32 inRate, opus_int32 outRate, int channels);
+
+  /* Consumes `samples` samples per channel from in and writes what is now
+     ready to out, which must hold maxOutput(samples) per channel. Returns
+     the number written per channel. */
+  int process(const float *in, int samples, float *out);
+  /* Ends the stream, writing the remaining output so that ceil(input *
+     outRate / inRate) samples come out in total. out must hold maxOutput(0)
+     per channel. */
+  int flush(float *out);
+
+  /* Most process() can write for `samples` input samples, or flush() for 0. */
+  int maxOutput(int samples) const;
+
+ private:
+  Resampler(const Resampler&);
+  Resampler& operator=(const Resampler&);
+
+  int drain(float *out, opus_int64 limit);
+  void compact();
+
+  int channels;
+  /* The rates reduced by their greatest common divisor. */
+  opus_int32 up;
+  opus_int32 down;
+  int phases;
+  int taps;
+  /* (phases + 1) rows of taps coefficients. */
+  std::vector<float> filter;
+  /* Planar input history, capacity samples per channel. */
+  std::vector<float> history;
+  int capacity;
+  int fill;
+  /* The next output sample lies at input time pos + frac / up. */
+  int pos;
+  opus_int32 frac;
+  opus_int64 consumed;
+  opus_int64 produced;
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "stream_decoder.h"
+#include "common.h"
+#include <stdio.h>
+#include <utility>
+
+using namespace v8;
+
+Nan::Persistent<Function> StreamDecoder::constructor;
+
+StreamDecoder::StreamDecoder(size_t capacity, Local<Function> onPcm_, Local<Function> onDrain_,
+                             Local<Function> onDone_)
+  : source(capacity), onPcm(onPcm_), onDrain(onDrain_), onDone(onDone_), resource("opusfile:StreamDecoder"),
+    drained(false), paused(false), stopping(false), finished(false) {
+  uv_mutex_init(&mutex);
+  uv_cond_init(&cond);
+}
+
+StreamDecoder::~StreamDecoder() {
+  uv_cond_destroy(&cond);
+  uv_mutex_destroy(&mutex);
+}
+
+NAN_MODULE_INIT(StreamDecoder::Init) {
+  Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(New);
+  tpl->SetClassName(Nan::New("StreamDecoder").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "push", Push);
+  Nan::SetPrototypeMethod(tpl, "end", End);
+  Nan::SetPrototypeMethod(tpl, "abort", Abort);
+  Nan::SetPrototypeMethod(tpl, "pause", Pause);
+  Nan::SetPrototypeMethod(tpl, "resume", Resume);
+
+  Local<Function> fn = Nan::GetFunction(tpl).ToLocalChecked();
+  constructor.Reset(fn);
+  Nan::Set(target, Nan::New("StreamDecoder").ToLocalChecked(), fn);
+}
+
+void StreamDecoder::Run(void *arg) {
+  static_cast<StreamDecoder *>(arg)->decode();
+}
+
+/* Decodes from the source until it ends, queueing every packet for
+   Deliver. The source reads on this thread, inside op_read. */
+void StreamDecoder::decode() {
+  char message[64] = "";
+  source.setDrainHook(Drained, this);
+
+  int status = 0;
+  OggOpusFile *of = op_open_callbacks(&source, &StreamSource::callbacks, NULL, 0, &status);
+  if (of == NULL) {
+    snprintf(message, sizeof(message), "failed to open input stream (%d)", status);
+  }
+
+  while (of) {
+    uv_mutex_lock(&mutex);
+    while (paused && !stopping) {
+      uv_cond_wait(&cond, &mutex);
+    }
+    bool stop = stopping;
+    uv_mutex_unlock(&mutex);
+    if (stop) {
+      snprintf(message, sizeof(message), "input stream aborted");
+      break;
+    }
+
+    int link = -1;
+    int res = op_read(of, pcm, MAX_READ_SAMPLES, &link);
+    if (res == OP_HOLE) {
+      continue;
+    }
+    if (res < 0) {
+      snprintf(message, sizeof(message), "failed decoding input stream (%d)", res);
+      break;
+    }
+    if (res == 0) {
+      break;
+    }
+
+    /* Copy outside the lock; only the swap into the queue holds it. */
+    Packet packet;
+    packet.link = link;
+    packet.channels = op_channel_count(of, link);
+    packet.pcm.assign(pcm, pcm + res * packet.channels);
+    uv_mutex_lock(&mutex);
+    packets.push_back(Packet());
+    std::swap(packets.back(), packet);
+    uv_mutex_unlock(&mutex);
+    uv_async_send(&async);
+  }
+
+  if (of) {
+    op_free(of);
+  }
+  source.setDrainHook(NULL, NULL);
+
+  uv_mutex_lock(&mutex);
+  error = message;
+  finished = true;
+  uv_mutex_unlock(&mutex);
+  uv_async_send(&async);
+}
+
+void StreamDecoder::Drained(void *arg) {
+  StreamDecoder *self = static_cast<StreamDecoder *>(arg);
+  uv_mutex_lock(&self->mutex);
+  self->drained = true;
+  uv_mutex_unlock(&self->mutex);
+  uv_async_send(&self->async);
+}
+
+/* Runs on the JS thread whenever the decoding thread has signalled; sends
+   coalesce, so everything queued since the last run goes out. finished is
+   only set after the last packet is queued, so onDone always comes after
+   all of the PCM. */
+void StreamDecoder::Deliver(uv_async_t *handle) {
+  StreamDecoder *self = static_cast<StreamDecoder *>(handle->data);
+  Nan::HandleScope scope;
+
+  std::deque<Packet> ready;
+  uv_mutex_lock(&self->mutex);
+  ready.swap(self->packets);
+  bool drained = self->drained;
+  self->drained = false;
+  bool finished = self->finished;
+  std::string error = self->error;
+  uv_mutex_unlock(&self->mutex);
+
+  for (size_t i = 0; i < ready.size(); i++) {
+    const Packet &packet = ready[i];
+    Local<Value> argv[] = {
+      Nan::CopyBuffer(reinterpret_cast<const char *>(&packet.pcm[0]), packet.pcm.size() * sizeof(opus_int16))
+        .ToLocalChecked(),
+      Nan::New<Number>(packet.link),
+      Nan::New<Number>(packet.channels)
+    };
+    self->onPcm.Call(3, argv, &self->resource);
+  }
+  if (drained) {
+    self->onDrain.Call(0, NULL, &self->resource);
+  }
+  if (finished) {
+    uv_thread_join(&self->thread);
+    uv_close(reinterpret_cast<uv_handle_t *>(&self->async), Closed);
+    Local<Value> argv[] = { Nan::Null() };
+    if (!error.empty()) {
+      argv[0] = Nan::Error(error.c_str());
+    }
+    self->onDone.Call(1, argv, &self->resource);
+  }
+}
+
+/* The handle is gone, so nothing refers to the decoder from native code any
+   more and the JS object may be collected. */
+void StreamDecoder::Closed(uv_handle_t *handle) {
+  static_cast<StreamDecoder *>(handle->data)->Unref();
+}
+
+NAN_METHOD(StreamDecoder::New) {
+  if (!info.IsConstructCall()) {
+    THROW_TYPE_ERROR("Use the new operator to create a StreamDecoder");
+  }
+  REQ_FUN_ARG(0, onPcm);
+  REQ_FUN_ARG(1, onDrain);
+  REQ_FUN_ARG(2, onDone);
+
+  double capacity = 256 * 1024;
+  if (info.Length() > 3 && !info[3]->IsUndefined()) {
+    capacity = Nan::To<double>(info[3]).FromMaybe(0);
+    if (!(capacity >= 4096 && capacity <= 64 * 1024 * 1024)) {
+      return Nan::ThrowRangeError("bufferSize must be between 4096 and 67108864");
+    }
+  }
+
+  StreamDecoder *decoder = new StreamDecoder((size_t)capacity, onPcm, onDrain, onDone);
+  decoder->Wrap(info.This());
+
+  uv_async_init(Nan::GetCurrentEventLoop(), &decoder->async, Deliver);
+  decoder->async.data = decoder;
+  if (uv_thread_create(&decoder->thread, Run, decoder) != 0) {
+    uv_close(reinterpret_cast<uv_handle_t *>(&decoder->async), NULL);
+    return Nan::ThrowError("failed to start the decoding thread");
+  }
+  /* The thread and the async handle refer to the decoder, so keep the JS
+     object alive until Closed. */
+  decoder->Ref();
+
+  info.GetReturnValue().Set(info.This());
+}
+
+/* push(chunk): queues as much of a Buffer as fits and returns the number of
+   bytes taken. The rest should be offered again once onDrain is called. */
+NAN_METHOD(StreamDecoder::Push) {
+  StreamDecoder *decoder = Nan::ObjectWrap::Unwrap<StreamDecoder>(info.Holder());
+  if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+    THROW_TYPE_ERROR("Argument 0 must be a Buffer");
+  }
+
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(node::Buffer::Data(info[0]));
+  size_t length = node::Buffer::Length(info[0]);
+  info.GetReturnValue().Set(Nan::New<Number>((double)decoder->source.push(data, length)));
+}
+
+NAN_METHOD(StreamDecoder::End) {
+  StreamDecoder *decoder = Nan::ObjectWrap::Unwrap<StreamDecoder>(info.Holder());
+  decoder->source.end();
+}
+
+NAN_METHOD(StreamDecoder::Abort) {
+  StreamDecoder *decoder = Nan::ObjectWrap::Unwrap<StreamDecoder>(info.Holder());
+  decoder->source.abort();
+  uv_mutex_lock(&decoder->mutex);
+  decoder->stopping = true;
+  uv_cond_signal(&decoder->cond);
+  uv_mutex_unlock(&decoder->mutex);
+}
+
+/* pause(): stop decoding before the next packet; resume() carries on. */
+NAN_METHOD(StreamDecoder::Pause) {
+  StreamDecoder *decoder = Nan::ObjectWrap::Unwrap<StreamDecoder>(info.Holder());
+  uv_mutex_lock(&decoder->mutex);
+  decoder->paused = true;
+  uv_mutex_unlock(&decoder->mutex);
+}
+
+NAN_METHOD(StreamDecoder::Resume) {
+  StreamDecoder *decoder = Nan::ObjectWrap::Unwrap<StreamDecoder>(info.Holder());
+  uv_mutex_lock(&decoder->mutex);
+  decoder->paused = false;
+  uv_cond_signal(&decoder->cond);
+  uv_mutex_unlock(&decoder->mutex);
+}
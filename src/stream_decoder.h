@@ -0,0 +1,76 @@
+#if !defined( STREAM_DECODER_H )
+#define STREAM_DECODER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <nan.h>
+#include <uv.h>
+#include "stream_source.h"
+
+/* Most op_read can return at once: 120 ms at 48 kHz, eight channels. */
+#define MAX_READ_SAMPLES (5760 * 8)
+
+/* JS handle for decoding Ogg Opus as it arrives:
+   new StreamDecoder(onPcm, onDrain, onDone[, bufferSize]), push(chunk),
+   end(), abort(), pause() and resume(). Each decoder has its own thread,
+   since it spends most of its life waiting for input and would otherwise
+   hold a libuv threadpool thread for as long as the upload lasts. Results
+   reach the JS thread through a uv_async_t: onPcm(pcm, link, channels) for
+   every packet, onDrain() when a full source has room again and, after the
+   last packet, onDone(err). pause() stops the thread before its next packet
+   until resume(), so a slow consumer holds back decoding rather than
+   letting PCM pile up. */
+class StreamDecoder : public Nan::ObjectWrap {
+ public:
+  static NAN_MODULE_INIT(Init);
+
+ private:
+  struct Packet {
+    int link;
+    int channels;
+    std::vector<opus_int16> pcm;
+  };
+
+  StreamDecoder(size_t capacity, v8::Local<v8::Function> onPcm, v8::Local<v8::Function> onDrain,
+                v8::Local<v8::Function> onDone);
+  ~StreamDecoder();
+
+  static NAN_METHOD(New);
+  static NAN_METHOD(Push);
+  static NAN_METHOD(End);
+  static NAN_METHOD(Abort);
+  static NAN_METHOD(Pause);
+  static NAN_METHOD(Resume);
+
+  static void Run(void *arg);
+  static void Drained(void *arg);
+  static void Deliver(uv_async_t *handle);
+  static void Closed(uv_handle_t *handle);
+  void decode();
+
+  static Nan::Persistent<v8::Function> constructor;
+
+  StreamSource source;
+  Nan::Callback onPcm;
+  Nan::Callback onDrain;
+  Nan::Callback onDone;
+  Nan::AsyncResource resource;
+  uv_thread_t thread;
+  uv_async_t async;
+
+  /* Guards everything below; cond wakes a paused thread. */
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  std::deque<Packet> packets;
+  bool drained;
+  bool paused;
+  bool stopping;
+  bool finished;
+  std::string error;
+
+  /* Only touched by the decoding thread. */
+  opus_int16 pcm[MAX_READ_SAMPLES];
+};
+
+#endif
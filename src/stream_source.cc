@@ -0,0 +1,105 @@
+#include "stream_source.h"
+#include <string.h>
+#include <algorithm>
+
+const OpusFileCallbacks StreamSource::callbacks = { StreamSource::Read, NULL, NULL, NULL };
+
+StreamSource::StreamSource(size_t capacity)
+  : ring(capacity), head(0), tail(0), ended(false), aborted(false), full(false),
+    drain_hook(NULL), drain_arg(NULL) {
+  uv_mutex_init(&mutex);
+  uv_cond_init(&cond);
+}
+
+StreamSource::~StreamSource() {
+  uv_cond_destroy(&cond);
+  uv_mutex_destroy(&mutex);
+}
+
+void StreamSource::wake() {
+  uv_mutex_lock(&mutex);
+  uv_cond_signal(&cond);
+  uv_mutex_unlock(&mutex);
+}
+
+size_t StreamSource::push(const unsigned char *data, size_t length) {
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t t = tail.load(std::memory_order_acquire);
+  size_t space = ring.size() - (h - t);
+  if (length > space) {
+    /* Say we are waiting before looking at tail again. The reader stores
+       tail before it clears full, all sequentially consistent, so either it
+       sees full and runs the drain hook or this second look sees the space
+       it freed. Looking only once could miss both. */
+    full.store(true);
+    t = tail.load();
+    space = ring.size() - (h - t);
+    if (length > space) {
+      length = space;
+    }
+  }
+  if (length == 0) {
+    return 0;
+  }
+
+  size_t at = h % ring.size();
+  size_t first = std::min(length, ring.size() - at);
+  memcpy(&ring[at], data, first);
+  memcpy(&ring[0], data + first, length - first);
+  head.store(h + length, std::memory_order_release);
+
+  wake();
+  return length;
+}
+
+void StreamSource::end() {
+  ended.store(true);
+  wake();
+}
+
+void StreamSource::abort() {
+  aborted.store(true);
+  wake();
+}
+
+int StreamSource::Read(void *stream, unsigned char *ptr, int nbytes) {
+  StreamSource *self = static_cast<StreamSource *>(stream);
+  std::vector<unsigned char> &ring = self->ring;
+
+  for (;;) {
+    if (self->aborted.load()) {
+      return -1;
+    }
+
+    size_t t = self->tail.load(std::memory_order_relaxed);
+    size_t h = self->head.load(std::memory_order_acquire);
+    if (h != t) {
+      size_t length = std::min((size_t)nbytes, h - t);
+      size_t at = t % ring.size();
+      size_t first = std::min(length, ring.size() - at);
+      memcpy(ptr, &ring[at], first);
+      memcpy(ptr + first, &ring[0], length - first);
+      self->tail.store(t + length);
+      if (self->full.exchange(false) && self->drain_hook) {
+        self->drain_hook(self->drain_arg);
+      }
+      return (int)length;
+    }
+    if (self->ended.load()) {
+      /* Data pushed before end() is visible by now: re-check once. */
+      if (self->head.load(std::memory_order_acquire) == t) {
+        return 0;
+      }
+      continue;
+    }
+
+    /* Empty: sleep until push(), end() or abort(). They signal under the
+       mutex, so checking again while holding it cannot miss a wakeup. */
+    uv_mutex_lock(&self->mutex);
+    while (self->head.load(std::memory_order_acquire) == t && !self->ended.load() &&
+           !self->aborted.load()) {
+      uv_cond_wait(&self->cond, &self->mutex);
+    }
+    uv_mutex_unlock(&self->mutex);
+  }
+}
@@ -0,0 +1,62 @@
+#if !defined( STREAM_SOURCE_H )
+#define STREAM_SOURCE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include <uv.h>
+#include "../deps/opusfile/include/opusfile.h"
+
+/* Non-seekable opusfile input fed from another thread. The data moves
+   through a single-producer, single-consumer ring without locks; the mutex
+   is only taken to put an empty-handed reader to sleep and wake it up.
+   The producer is the JS thread, pushing chunks as they arrive, and the
+   consumer is opusfile reading through `callbacks`. */
+class StreamSource {
+ public:
+  explicit StreamSource(size_t capacity);
+  ~StreamSource();
+
+  /* Copies as much of data as fits and returns how much that was. Less
+     than length means the ring is full and the caller should hold off until
+     the drain hook runs. */
+  size_t push(const unsigned char *data, size_t length);
+  /* No more data will be pushed; reads return 0 once the ring is empty. */
+  void end();
+  /* Makes pending and future reads fail. */
+  void abort();
+
+  /* Called on the reading thread when it frees space after a push() came
+     up short. It may also run once when push() found the space on a second
+     look, so the hook must tolerate having nothing to offer. */
+  void setDrainHook(void (*hook)(void *), void *arg) {
+    drain_hook = hook;
+    drain_arg = arg;
+  }
+
+  /* For op_open_callbacks with this source as the stream. There is no
+     seek or tell, so opusfile treats the input as unseekable. */
+  static const OpusFileCallbacks callbacks;
+
+ private:
+  StreamSource(const StreamSource&);
+  StreamSource& operator=(const StreamSource&);
+
+  static int Read(void *stream, unsigned char *ptr, int nbytes);
+  void wake();
+
+  std::vector<unsigned char> ring;
+  /* Total bytes ever written and read; their difference is the fill. */
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<bool> ended;
+  std::atomic<bool> aborted;
+  std::atomic<bool> full;
+  void (*drain_hook)(void *);
+  void *drain_arg;
+
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+};
+
+#endif
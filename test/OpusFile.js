@@ -1,4 +1,77 @@
 var OpusFile = require('..');
+var expect = require('chai').expect;
+
+// Minimal Ogg page handling for building test inputs. Pages and packets are
+// Buffers; a page returned by oggPages() shares memory with the file.
+var oggCrcTable = (function() {
+  var table = [];
+  for (var n = 0; n < 256; n++) {
+    var r = n << 24;
+    for (var k = 0; k < 8; k++) {
+      r = r & 0x80000000 ? (r << 1) ^ 0x04c11db7 : r << 1;
+    }
+    table.push(r >>> 0);
+  }
+  return table;
+})();
+
+function setOggCrc(page) {
+  page.writeUInt32LE(0, 22);
+  var crc = 0;
+  for (var i = 0; i < page.length; i++) {
+    crc = ((crc << 8) ^ oggCrcTable[((crc >>> 24) ^ page[i]) & 0xff]) >>> 0;
+  }
+  page.writeUInt32LE(crc, 22);
+}
+
+function oggPages(data) {
+  var pages = [];
+  for (var pos = 0; pos < data.length; ) {
+    var size = 27 + data[pos + 26];
+    for (var i = 0; i < data[pos + 26]; i++) {
+      size += data[pos + 27 + i];
+    }
+    pages.push(data.slice(pos, pos + size));
+    pos += size;
+  }
+  return pages;
+}
+
+// The packets of a single-stream file, headers included.
+function oggPackets(data) {
+  var packets = [];
+  var parts = [];
+  oggPages(data).forEach(function(page) {
+    var body = 27 + page[26];
+    for (var i = 0; i < page[26]; i++) {
+      parts.push(page.slice(body, body + page[27 + i]));
+      body += page[27 + i];
+      if (page[27 + i] < 255) {
+        packets.push(Buffer.concat(parts));
+        parts = [];
+      }
+    }
+  });
+  return packets;
+}
+
+// A page holding one packet; flags 2 marks the first page, 4 the last.
+function oggPage(packet, granule, sequence, flags) {
+  var lacing = [];
+  for (var left = packet.length; left >= 255; left -= 255) {
+    lacing.push(255);
+  }
+  lacing.push(left);
+  var page = Buffer.concat([Buffer.alloc(27), Buffer.from(lacing), packet]);
+  page.write('OggS', 0);
+  page[5] = flags;
+  page.writeUInt32LE(granule, 6);
+  page.writeUInt32LE(0x4f707573, 14);
+  page.writeUInt32LE(sequence, 18);
+  page[26] = lacing.length;
+  setOggCrc(page);
+  return page;
+}
 
 describe('OpusFile', function() {
   it('should convert ./test/data/input.opus to ./test/data/output.opus',
@@ -7,4 +80,739 @@ describe('OpusFile', function() {
       // number of converted frames: 392
       done();
   });
+
+  it('should convert asynchronously and resolve with the frame count',
+    function() {
+      return OpusFile.normalize('./test/data/input.opus', './test/data/output-async.opus')
+        .then(function(result) {
+          expect(result.frames).to.equal(392);
+        });
+  });
+
+  it('should call back with an error for a missing input file',
+    function( done ) {
+      OpusFile.normalize('./test/data/missing.opus', './test/data/output-missing.opus',
+        function(err) {
+          expect(err).to.be.an('error');
+          done();
+        });
+  });
+
+  it('should reject paths that are not strings',
+    function() {
+      return OpusFile.normalize(undefined, './test/data/output-undefined.opus')
+        .then(function() {
+          throw new Error('a missing input path should not normalize');
+        }, function(err) {
+          expect(err).to.be.an.instanceof(TypeError);
+        });
+  });
+
+  it('should run several normalizations concurrently',
+    function() {
+      var jobs = [0, 1, 2, 3].map(function(n) {
+        return OpusFile.normalize('./test/data/input.opus', './test/data/output-' + n + '.opus');
+      });
+      return Promise.all(jobs).then(function(results) {
+        results.forEach(function(result) {
+          expect(result.frames).to.equal(392);
+        });
+      });
+  });
+
+  it('should encode PCM frames through an OpusWriter',
+    function() {
+      var writer = new OpusFile.OpusWriter('./test/data/output-writer.opus');
+      var frame = Buffer.alloc(1920);
+      for (var i = 0; i < 10; i++) {
+        writer.write(frame);
+      }
+      writer.write(frame.slice(0, 640));
+      writer.close();
+      expect(function() { writer.write(frame); }).to.throw(Error);
+  });
+
+  it('should resample PCM written at a rate Opus does not code at',
+    function() {
+      var path = './test/data/output-writer-44100.opus';
+      var writer = new OpusFile.OpusWriter(path, { sampleRate: 44100, frameDuration: 20 });
+      // One second of a 1 kHz tone, ending on a short frame.
+      var frame = Buffer.alloc(882 * 2);
+      for (var i = 0; i < 44099; i++) {
+        frame.writeInt16LE(Math.round(8000 * Math.sin(2 * Math.PI * 1000 * i / 44100)), (i % 882) * 2);
+        if (i % 882 === 881) {
+          writer.write(frame);
+        }
+      }
+      writer.write(frame.slice(0, (44099 % 882) * 2));
+      writer.close();
+
+      var decoder = new OpusFile.OpusDecoder(path);
+      // ceil(44099 * 48000 / 44100)
+      expect(decoder.pcmTotal()).to.equal(47999);
+
+      var pcm = new Int16Array(48000);
+      var total = 0;
+      var read;
+      while ((read = decoder.readInto(pcm.subarray(total))).samples > 0) {
+        total += read.samples;
+      }
+      decoder.close();
+      expect(total).to.equal(47999);
+
+      // Still 1 kHz after resampling: about two zero crossings per ms.
+      var crossings = 0;
+      for (i = 4800 + 1; i < 43200; i++) {
+        if ((pcm[i - 1] < 0) !== (pcm[i] < 0)) {
+          crossings++;
+        }
+      }
+      expect(crossings).to.be.within(1568, 1632);
+      return OpusFile.probe(path).then(function(info) {
+        expect(info.inputSampleRate).to.equal(44100);
+      });
+  });
+
+  it('should normalize a batch on a bounded pool and report each file',
+    function() {
+      var jobs = [0, 1, 2, 3, 4].map(function(n) {
+        return { in: './test/data/input.opus', out: './test/data/output-batch-' + n + '.opus' };
+      });
+      jobs.push({ in: './test/data/missing.opus', out: './test/data/output-batch-missing.opus' });
+
+      return OpusFile.normalizeBatch(jobs, { concurrency: 2 }).then(function(results) {
+        expect(results).to.have.length(6);
+        results.slice(0, 5).forEach(function(result) {
+          expect(result.error).to.equal(undefined);
+          expect(result.frames).to.equal(392);
+        });
+        expect(results[5].error).to.be.an('error');
+      });
+  });
+
+  it('should reject batch jobs without string paths',
+    function() {
+      var jobs = [{ in: './test/data/input.opus' }];
+      return OpusFile.normalizeBatch(jobs)
+        .then(function() {
+          throw new Error('a job without an output path should not run');
+        }, function(err) {
+          expect(err).to.be.an.instanceof(TypeError);
+        });
+  });
+
+  it('should pack several packets per Ogg page when maxDelay is raised',
+    function() {
+      return Promise.all([
+        OpusFile.normalize('./test/data/input.opus', './test/data/output-live.opus', { maxDelay: 0 }),
+        OpusFile.normalize('./test/data/input.opus', './test/data/output-packed.opus', { maxDelay: 1000 })
+      ]).then(function(results) {
+        var live = results[0], packed = results[1];
+        expect(packed.frames).to.equal(live.frames);
+        expect(packed.pagesOut).to.be.below(live.pagesOut / 10);
+        expect(packed.bytesWritten).to.be.below(live.bytesWritten);
+      });
+  });
+
+  it('should coalesce page writes up to flushThreshold',
+    function() {
+      return Promise.all([
+        OpusFile.normalize('./test/data/input.opus', './test/data/output-unbuffered.opus', { flushThreshold: 0 }),
+        OpusFile.normalize('./test/data/input.opus', './test/data/output-buffered.opus', { flushThreshold: 65536 })
+      ]).then(function(results) {
+        var unbuffered = results[0], buffered = results[1];
+        expect(unbuffered.writeCalls).to.equal(unbuffered.pagesOut);
+        expect(buffered.bytesWritten).to.equal(unbuffered.bytesWritten);
+        expect(buffered.writeCalls).to.be.at.most(Math.ceil(buffered.bytesWritten / 65536) + 1);
+      });
+  });
+
+  it('should not allocate after the first frame',
+    function() {
+      var fs = require('fs');
+      var childProcess = require('child_process');
+      var counter = './build/Release/alloc_counter.so';
+      if (!fs.existsSync(counter)) {
+        // Only built on Linux.
+        this.skip();
+      }
+      // Every malloc and operator new in the child is counted, libopus and
+      // libogg included, not just the ones the recorder knows about.
+      var script = "var OpusFile = require('.'), out = {};" +
+        "var w = new OpusFile.OpusWriter('./test/data/output-noalloc.opus', { maxDelay: 1000 });" +
+        "var frame = Buffer.alloc(1920);" +
+        "for (var i = 0; i < 50; i++) w.write(frame);" +
+        "w.write(frame.slice(0, 100));" +
+        "out.writer = w.stats().frameAllocations; w.close();" +
+        "OpusFile.normalize('./test/data/input.opus', './test/data/output-noalloc-2.opus').then(function(r) {" +
+        "  out.normalize = r.frameAllocations; process.stdout.write(JSON.stringify(out)); });";
+      var result = JSON.parse(childProcess.execFileSync(process.execPath, ['-e', script], {
+        env: Object.assign({}, process.env, { LD_PRELOAD: require('path').resolve(counter) }),
+        encoding: 'utf8'
+      }));
+      expect(result).to.deep.equal({ writer: 0, normalize: 0 });
+  });
+
+  it('should honour per-job encoder options',
+    function() {
+      var options = {
+        sampleRate: 48000,
+        channels: 2,
+        bitrate: 32000,
+        complexity: 0,
+        cvbr: true,
+        frameDuration: 20,
+        application: 'voip'
+      };
+      return OpusFile.normalize('./test/data/input.opus', './test/data/output-options.opus', options)
+        .then(function(result) {
+          // 392 input packets of 60 ms re-framed into 20 ms frames
+          expect(result.frames).to.equal(392 * 3);
+        });
+  });
+
+  it('should reject invalid encoder options',
+    function() {
+      expect(function() {
+        OpusFile.Normalize('./test/data/input.opus', './test/data/output-bad.opus', { sampleRate: 4000 });
+      }).to.throw(RangeError);
+      expect(function() {
+        OpusFile.Normalize('./test/data/input.opus', './test/data/output-bad.opus', { application: 'music' });
+      }).to.throw(RangeError);
+      expect(function() {
+        OpusFile.Normalize('./test/data/input.opus', './test/data/output-bad.opus', { channels: 1.5 });
+      }).to.throw(RangeError);
+  });
+
+  it('should demux and decode Ogg Opus input',
+    function() {
+      return OpusFile.normalize('./test/data/input.opus', './test/data/output-ogg-source.opus')
+        .then(function() {
+          return OpusFile.normalize('./test/data/output-ogg-source.opus', './test/data/output-from-ogg.opus');
+        })
+        .then(function(result) {
+          // 392 * 60 ms less the pre-skip, re-encoded in 60 ms frames
+          expect(result.frames).to.equal(392);
+        });
+  });
+
+  it('should remux Ogg Opus input without re-encoding',
+    function() {
+      return OpusFile.normalize('./test/data/input.opus', './test/data/output-remux-source.opus')
+        .then(function() {
+          return OpusFile.normalize('./test/data/output-remux-source.opus', './test/data/output-remux.opus',
+                                    { mode: 'remux', maxDelay: 1000 });
+        })
+        .then(function(result) {
+          // Every source packet is copied, but packed into fewer pages.
+          expect(result.frames).to.equal(392);
+          expect(result.pagesOut).to.be.below(392);
+          return OpusFile.normalize('./test/data/input.opus', './test/data/output-remux.opus', { mode: 'remux' });
+        })
+        .then(function() {
+          throw new Error('raw input should not remux');
+        }, function(err) {
+          expect(err.message).to.equal('only Ogg Opus input can be remuxed');
+        });
+  });
+
+  it('should keep start trimming when remuxing',
+    function() {
+      var fs = require('fs');
+      var source = './test/data/output-remux-trim-source.opus';
+      var trimmed = './test/data/output-remux-trimmed.opus';
+      var output = './test/data/output-remux-trim.opus';
+      return OpusFile.normalize('./test/data/input.opus', source, { maxDelay: 1000 })
+        .then(function() {
+          // Move every audio page 20 ms earlier, so the first one ends before
+          // all of its samples: the first 960 are to be trimmed.
+          var data = fs.readFileSync(source);
+          oggPages(data).slice(2).forEach(function(page) {
+            page.writeUInt32LE(page.readUInt32LE(6) - 960, 6);
+            setOggCrc(page);
+          });
+          fs.writeFileSync(trimmed, data);
+          return OpusFile.normalize(trimmed, output, { mode: 'remux' });
+        })
+        .then(function(result) {
+          expect(result.frames).to.equal(392);
+          var before = fs.readFileSync(source);
+          var after = fs.readFileSync(output);
+          var preSkip = before.readUInt16LE(before.indexOf('OpusHead') + 10);
+          expect(after.readUInt16LE(after.indexOf('OpusHead') + 10)).to.equal(preSkip + 960);
+
+          // The same audio less its first 960 samples.
+          var original = new OpusFile.OpusDecoder(source);
+          var remuxed = new OpusFile.OpusDecoder(output);
+          var channels = original.channelCount();
+          expect(remuxed.pcmTotal()).to.equal(original.pcmTotal() - 960);
+          function readSamples(decoder, samples) {
+            var pcm = new Int16Array(samples * channels);
+            for (var got = 0; got < samples; ) {
+              got += decoder.readInto(pcm.subarray(got * channels)).samples;
+            }
+            return Buffer.from(pcm.buffer);
+          }
+          readSamples(original, 960);
+          expect(readSamples(remuxed, 5760).equals(readSamples(original, 5760))).to.equal(true);
+          original.close();
+          remuxed.close();
+        });
+  });
+
+  it('should set the output gain without touching the audio',
+    function() {
+      var fs = require('fs');
+      var source = './test/data/output-gain-source.opus';
+      return OpusFile.normalize('./test/data/input.opus', source)
+        .then(function() {
+          return OpusFile.normalize(source, './test/data/output-gain.opus', { mode: 'gain', gain: -3.5 });
+        })
+        .then(function(result) {
+          var before = fs.readFileSync(source);
+          var after = fs.readFileSync('./test/data/output-gain.opus');
+          expect(result.bytesWritten).to.equal(before.length);
+          expect(after.readInt16LE(after.indexOf('OpusHead') + 16)).to.equal(-896);
+          // Only the OpusHead gain and the first page's CRC differ.
+          var differing = 0;
+          for (var i = 0; i < before.length; i++) {
+            if (before[i] !== after[i]) {
+              differing++;
+            }
+          }
+          expect(differing).to.be.within(1, 6);
+          // Spelled differently, the output is still the input and is
+          // patched in place rather than truncated while being read.
+          return OpusFile.normalize(source, 'test/data/../data/output-gain-source.opus', { mode: 'gain', gain: -3.5 });
+        })
+        .then(function() {
+          expect(fs.readFileSync(source).equals(fs.readFileSync('./test/data/output-gain.opus'))).to.equal(true);
+        });
+  });
+
+  it('should end a stream that stops on a whole frame',
+    function() {
+      var source = './test/data/output-aligned-source.opus';
+      var writer = new OpusFile.OpusWriter(source);
+      var frame = Buffer.alloc(1920);
+      for (var i = 0; i < 10; i++) {
+        writer.write(frame);
+      }
+      writer.close();
+
+      var decoder = new OpusFile.OpusDecoder(source);
+      // 9600 samples at 16 kHz, decoded at 48 kHz
+      expect(decoder.pcmTotal()).to.equal(28800);
+      decoder.close();
+
+      return OpusFile.normalize(source, './test/data/output-aligned.opus')
+        .then(function() {
+          var normalized = new OpusFile.OpusDecoder('./test/data/output-aligned.opus');
+          expect(normalized.pcmTotal()).to.equal(28800);
+          normalized.close();
+        });
+  });
+
+  it('should decode into caller-provided typed arrays through an OpusDecoder',
+    function() {
+      var writer = new OpusFile.OpusWriter('./test/data/output-decoder.opus');
+      var frame = Buffer.alloc(1920);
+      for (var i = 0; i < 10; i++) {
+        writer.write(frame);
+      }
+      writer.write(frame.slice(0, 640));
+      writer.close();
+
+      var decoder = new OpusFile.OpusDecoder('./test/data/output-decoder.opus');
+      // 9920 samples at 16 kHz, decoded at 48 kHz
+      expect(decoder.pcmTotal()).to.equal(29760);
+      expect(decoder.channelCount()).to.equal(1);
+
+      var pcm = new Int16Array(5760);
+      var total = 0;
+      var read;
+      while ((read = decoder.readInto(pcm)).samples > 0) {
+        expect(read.link).to.equal(0);
+        total += read.samples;
+      }
+      expect(total).to.equal(29760);
+
+      decoder.pcmSeek(0);
+      expect(decoder.pcmTell()).to.equal(0);
+      expect(decoder.readInto(new Float32Array(5760)).samples).to.be.above(0);
+      decoder.close();
+      expect(function() { decoder.readInto(pcm); }).to.throw(Error);
+  });
+
+  it('should decode 16-bit reads in whichever flavor is built',
+    function() {
+      expect(OpusFile.fixedPoint).to.be.a('boolean');
+
+      var decoder = new OpusFile.OpusDecoder('./test/data/output-decoder.opus');
+      var pcm = new Int16Array(5760);
+      var total = 0;
+      var read;
+      while ((read = decoder.readInto(pcm)).samples > 0) {
+        total += read.samples;
+      }
+      expect(total).to.equal(29760);
+      decoder.close();
+  });
+
+  it('should hand out buffers decoded ahead by a prefetching OpusDecoder',
+    function() {
+      var decoder = new OpusFile.OpusDecoder('./test/data/output-decoder.opus', { prefetch: 3 });
+      var total = 0;
+      var read;
+      while ((read = decoder.read()) !== null) {
+        expect(read.pcm.length).to.equal(read.samples);
+        total += read.samples;
+      }
+      expect(total).to.equal(29760);
+      expect(decoder.pcmTell()).to.equal(29760);
+
+      decoder.pcmSeek(9600);
+      read = decoder.read();
+      expect(read.samples).to.be.above(0);
+      expect(decoder.pcmTell()).to.be.above(9600);
+      expect(function() { decoder.readInto(new Int16Array(5760)); }).to.throw(Error);
+      decoder.close();
+  });
+
+  it('should prefetch two channels when asked for stereo',
+    function() {
+      var decoder = new OpusFile.OpusDecoder('./test/data/output-decoder.opus', { stereo: true, prefetch: 3 });
+      var total = 0;
+      var read;
+      while ((read = decoder.read()) !== null) {
+        expect(read.pcm.length).to.equal(read.samples * 2);
+        total += read.samples;
+      }
+      expect(total).to.equal(29760);
+      expect(decoder.channelCount()).to.equal(2);
+      decoder.close();
+  });
+
+  it('should decode at a reduced rate with positions in its samples',
+    function() {
+      var decoder = new OpusFile.OpusDecoder('./test/data/output-decoder.opus', { rate: 16000 });
+      expect(decoder.pcmTotal()).to.equal(9920);
+
+      var pcm = new Int16Array(1920);
+      var total = 0;
+      var read;
+      while ((read = decoder.readInto(pcm)).samples > 0) {
+        total += read.samples;
+      }
+      expect(total).to.equal(9920);
+      expect(decoder.pcmTell()).to.equal(9920);
+
+      decoder.pcmSeek(3200);
+      expect(decoder.pcmTell()).to.equal(3200);
+      total = 0;
+      while ((read = decoder.readInto(pcm)).samples > 0) {
+        total += read.samples;
+      }
+      expect(total).to.equal(9920 - 3200);
+      decoder.close();
+
+      expect(function() {
+        new OpusFile.OpusDecoder('./test/data/output-decoder.opus', { rate: 44100 });
+      }).to.throw(RangeError);
+  });
+
+  it('should find the links of a lazily opened chained file on demand',
+    function() {
+      var fs = require('fs');
+      var writer = new OpusFile.OpusWriter('./test/data/output-link.opus');
+      writer.write(Buffer.alloc(1920));
+      writer.close();
+      var chained = './test/data/output-chained.opus';
+      fs.writeFileSync(chained, Buffer.concat([
+        fs.readFileSync('./test/data/output-decoder.opus'),
+        fs.readFileSync('./test/data/output-link.opus')
+      ]));
+
+      // Playback runs straight into the second link...
+      var decoder = new OpusFile.OpusDecoder(chained, { lazy: true });
+      var pcm = new Int16Array(5760);
+      var totals = [0, 0];
+      var read;
+      while ((read = decoder.readInto(pcm)).samples > 0) {
+        totals[read.link] += read.samples;
+      }
+      expect(totals).to.deep.equal([29760, 2880]);
+      decoder.close();
+
+      // ...and a query before that scans the file from the first one.
+      decoder = new OpusFile.OpusDecoder(chained, { lazy: true });
+      expect(decoder.readInto(pcm).link).to.equal(0);
+      expect(decoder.pcmTotal()).to.equal(29760 + 2880);
+      expect(decoder.pcmTotal(1)).to.equal(2880);
+      decoder.close();
+  });
+
+  it('should decode Ogg Opus held in memory',
+    function() {
+      var data = require('fs').readFileSync('./test/data/output-decoder.opus');
+      var sources = [data, data.buffer.slice(data.byteOffset, data.byteOffset + data.length)];
+      sources.forEach(function(source) {
+        var decoder = new OpusFile.OpusDecoder(source);
+        expect(decoder.pcmTotal()).to.equal(29760);
+        var pcm = new Int16Array(5760);
+        var total = 0;
+        var read;
+        while ((read = decoder.readInto(pcm)).samples > 0) {
+          total += read.samples;
+        }
+        expect(total).to.equal(29760);
+        decoder.close();
+      });
+  });
+
+  it('should decode Ogg Opus while it streams in',
+    function() {
+      var fs = require('fs');
+      var bytes = 0;
+      var format = null;
+      // A tiny native buffer makes the stream push back on its source.
+      var decoder = OpusFile.createDecodeStream({ bufferSize: 4096 });
+      decoder.on('format', function(f) { format = f; });
+      decoder.on('data', function(pcm) { bytes += pcm.length; });
+
+      return new Promise(function(resolve, reject) {
+        decoder.on('end', resolve);
+        decoder.on('error', reject);
+        fs.createReadStream('./test/data/output-decoder.opus', { highWaterMark: 512 }).pipe(decoder);
+      }).then(function() {
+        expect(format).to.deep.equal({ link: 0, channels: 1 });
+        expect(bytes).to.equal(29760 * 2);
+      });
+  });
+
+  it('should keep streaming when every write overfills the native buffer',
+    function() {
+      var fs = require('fs');
+      var source = './test/data/output-stream-source.opus';
+      return OpusFile.normalize('./test/data/input.opus', source).then(function() {
+        var file = new OpusFile.OpusDecoder(source);
+        var expected = file.pcmTotal() * file.channelCount() * 2;
+        file.close();
+
+        var bytes = 0;
+        // Chunks 16 times the ring, so each push comes up short many times
+        // while the decoder thread keeps emptying it.
+        var decoder = OpusFile.createDecodeStream({ bufferSize: 4096 });
+        decoder.on('data', function(pcm) { bytes += pcm.length; });
+        return new Promise(function(resolve, reject) {
+          decoder.on('end', resolve);
+          decoder.on('error', reject);
+          fs.createReadStream(source, { highWaterMark: 65536 }).pipe(decoder);
+        }).then(function() {
+          expect(bytes).to.equal(expected);
+        });
+      });
+  });
+
+  it('should leave the threadpool free while streams wait for input',
+    function() {
+      var fs = require('fs');
+      var source = './test/data/output-decoder.opus';
+      // Twice the default UV_THREADPOOL_SIZE, all idle until fed.
+      var decoders = [];
+      for (var i = 0; i < 8; i++) {
+        decoders.push(OpusFile.createDecodeStream());
+      }
+
+      return new Promise(function(resolve, reject) {
+        fs.readFile(source, function(err) { return err ? reject(err) : resolve(); });
+      }).then(function() {
+        return Promise.all(decoders.map(function(decoder) {
+          return new Promise(function(resolve, reject) {
+            var bytes = 0;
+            // A slow reader fills the readable side, pausing the decoder.
+            function consume() {
+              var pcm;
+              while ((pcm = decoder.read()) !== null) {
+                bytes += pcm.length;
+              }
+              setTimeout(function() { decoder.once('readable', consume); }, 5);
+            }
+            decoder.once('readable', consume);
+            decoder.on('end', function() { resolve(bytes); });
+            decoder.on('error', reject);
+            fs.createReadStream(source).pipe(decoder);
+          });
+        }));
+      }).then(function(counts) {
+        counts.forEach(function(bytes) {
+          expect(bytes).to.equal(29760 * 2);
+        });
+      });
+  });
+
+  it('should seek through a saved seek index',
+    function() {
+      var source = './test/data/output-index-source.opus';
+      return OpusFile.normalize('./test/data/input.opus', source, { maxDelay: 1000 })
+        .then(function() {
+          var decoder = new OpusFile.OpusDecoder(source);
+          decoder.buildSeekIndex();
+          var index = decoder.saveSeekIndex();
+          expect(index.length).to.be.above(0);
+          decoder.close();
+
+          decoder = new OpusFile.OpusDecoder(source, { seekIndex: index });
+          decoder.pcmSeek(480000);
+          expect(decoder.pcmTell()).to.equal(480000);
+          expect(decoder.readInto(new Int16Array(5760)).samples).to.be.above(0);
+          decoder.close();
+
+          expect(function() {
+            new OpusFile.OpusDecoder('./test/data/output-decoder.opus', { seekIndex: index });
+          }).to.throw(Error);
+        });
+  });
+  it('should probe metadata once and answer repeats from the cache',
+    function() {
+      var fs = require('fs');
+      var path = './test/data/output-decoder.opus';
+      var saved = './test/data/output-probe-cache.bin';
+      OpusFile.probeCache.clear();
+
+      var info;
+      return OpusFile.probe(path)
+        .then(function(result) {
+          info = result;
+          expect(info.duration).to.equal(29760);
+          expect(info.links).to.equal(1);
+          expect(info.channels).to.equal(1);
+          expect(info.inputSampleRate).to.equal(16000);
+          expect(info.tags).to.be.an('array');
+          return OpusFile.probe(path);
+        })
+        .then(function(result) {
+          expect(result).to.deep.equal(info);
+          expect(OpusFile.probeCache.stats()).to.include({ entries: 1, hits: 1, misses: 1 });
+
+          OpusFile.probeCache.save(saved);
+          OpusFile.probeCache.clear();
+          expect(OpusFile.probeCache.load(saved)).to.equal(1);
+          return OpusFile.probe(path);
+        })
+        .then(function(result) {
+          expect(result).to.deep.equal(info);
+          expect(OpusFile.probeCache.stats().hits).to.equal(1);
+          fs.unlinkSync(saved);
+          return OpusFile.probe('./test/data/missing.opus');
+        })
+        .then(function() {
+          throw new Error('a missing file should not probe');
+        }, function(err) {
+          expect(err.message).to.match(/^failed to probe input file/);
+        });
+  });
+  it('should probe many files at once into typed arrays',
+    function() {
+      var paths = ['./test/data/output-decoder.opus', './test/data/missing.opus', './index.js',
+                   './test/data/output-chained.opus'];
+      return OpusFile.probeMany(paths, { concurrency: 2, duration: true }).then(function(result) {
+        expect(result.status[0]).to.equal(0);
+        expect(result.status[1]).to.be.below(0);
+        expect(result.status[2]).to.be.below(0);
+        expect(result.channels[0]).to.equal(1);
+        expect(result.duration[0]).to.equal(29760);
+        expect(result.duration[1]).to.equal(-1);
+        // Chained files are measured by probe() instead.
+        expect(result.status[3]).to.equal(0);
+        expect(result.duration[3]).to.equal(-1);
+        // Without duration only the first pages are read, to the same verdict.
+        return OpusFile.probeMany(paths, { concurrency: 2 }).then(function(headOnly) {
+          expect(Array.from(headOnly.status)).to.deep.equal(Array.from(result.status));
+          expect(Array.from(headOnly.channels)).to.deep.equal(Array.from(result.channels));
+          expect(Array.from(headOnly.duration)).to.deep.equal([-1, -1, -1, -1]);
+        });
+      });
+  });
+
+  it('should convert to the same PCM with every SIMD kernel',
+    function() {
+      var fs = require('fs');
+      var childProcess = require('child_process');
+      var stereo = './test/data/output-stereo.opus';
+      var surround = './test/data/output-surround.opus';
+      // Four encodes of the same input become the streams of a 5.1 file, so
+      // that the 3+ channel downmix and the 5-8 channel kernels run too.
+      var sources = [
+        { channels: 2, bitrate: 64000 },
+        { channels: 2, bitrate: 32000 },
+        { channels: 1, bitrate: 32000 },
+        { channels: 1, bitrate: 16000 }
+      ];
+      var script = "var o = JSON.parse(process.argv[2]), d = new (require('.').OpusDecoder)(process.argv[1], o);" +
+        "var c = o.stereo ? 2 : d.channelCount(), h = require('crypto').createHash('sha1');" +
+        "var pcm = new Int16Array(5760 * c), r;" +
+        "while ((r = d.readInto(pcm)).samples > 0) h.update(Buffer.from(pcm.buffer, 0, r.samples * c * 2));" +
+        "process.stdout.write(h.digest('hex'));";
+
+      // Self-delimiting framing (RFC 6716, appendix B) for all but the last
+      // stream of a multistream packet.
+      function selfDelimited(packet) {
+        expect(packet[0] & 3).to.equal(0);
+        var n = packet.length - 1;
+        var size = n < 252 ? [n] : [252 + (n & 3), (n - 252 - (n & 3)) >> 2];
+        return Buffer.concat([packet.slice(0, 1), Buffer.from(size), packet.slice(1)]);
+      }
+
+      return OpusFile.normalize('./test/data/input.opus', stereo, { sampleRate: 48000, channels: 2 })
+        .then(function() {
+          return Promise.all(sources.map(function(options, i) {
+            var file = './test/data/output-surround-' + i + '.opus';
+            return OpusFile.normalize('./test/data/input.opus', file, {
+              sampleRate: 48000,
+              channels: options.channels,
+              bitrate: options.bitrate,
+              frameDuration: 20
+            }).then(function() {
+              return oggPackets(fs.readFileSync(file));
+            });
+          }));
+        })
+        .then(function(streams) {
+          var preSkip = 0;
+          streams.forEach(function(packets) {
+            preSkip = Math.max(preSkip, packets[0].readUInt16LE(10));
+          });
+          // Family 1 in Vorbis order: L, C, R, RL, RR, LFE.
+          var head = Buffer.from([0x4f, 0x70, 0x75, 0x73, 0x48, 0x65, 0x61, 0x64, 1, 6, 0, 0, 0x80, 0xbb, 0, 0,
+                                  0, 0, 1, 4, 2, 0, 4, 1, 2, 3, 5]);
+          head.writeUInt16LE(preSkip, 10);
+          var tags = Buffer.from('OpusTags\x04\0\0\0test\0\0\0\0', 'latin1');
+          var pages = [oggPage(head, 0, 0, 2), oggPage(tags, 0, 1, 0)];
+          var count = Math.min.apply(null, streams.map(function(packets) { return packets.length; })) - 2;
+          for (var i = 0; i < count; i++) {
+            var packet = Buffer.concat(streams.map(function(packets, s) {
+              var p = packets[i + 2];
+              return s < streams.length - 1 ? selfDelimited(p) : p;
+            }));
+            pages.push(oggPage(packet, (i + 1) * 960, i + 2, i === count - 1 ? 4 : 0));
+          }
+          fs.writeFileSync(surround, Buffer.concat(pages));
+          expect(new OpusFile.OpusDecoder(surround).channelCount()).to.equal(6);
+
+          [stereo, surround].forEach(function(file) {
+            [{}, { dither: false }, { stereo: true }].forEach(function(options) {
+              var hashes = ['none', 'sse2', 'avx2'].map(function(kernel) {
+                return childProcess.execFileSync(process.execPath, ['-e', script, file, JSON.stringify(options)], {
+                  env: Object.assign({}, process.env, { OPUSFILE_SIMD: kernel }),
+                  encoding: 'utf8'
+                });
+              });
+              expect(hashes[0]).to.have.length(40);
+              expect(hashes[1]).to.equal(hashes[0]);
+              expect(hashes[2]).to.equal(hashes[0]);
+            });
+          });
+        });
+  });
 });
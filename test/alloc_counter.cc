@@ -0,0 +1,98 @@
+/* Counting allocator for the allocation tests. Built as its own shared
+   library by the alloc_counter target and preloaded into a test process with
+   LD_PRELOAD, it stands in for malloc, calloc, realloc, the aligned
+   allocators and operator new everywhere in the process, libopus and libogg
+   included, and counts the calls made on each thread. The addon finds
+   opusfile_thread_allocations() with dlsym; see src/alloc_count.h. */
+#include <errno.h>
+#include <stddef.h>
+#include <new>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+/* initial-exec, so that reading it never allocates: this library is loaded
+   with the program and its TLS lives in the static block. */
+static __thread unsigned long long allocations __attribute__((tls_model("initial-exec")));
+
+extern "C" {
+
+__attribute__((visibility("default"))) unsigned long long opusfile_thread_allocations(void) {
+  return allocations;
+}
+
+__attribute__((visibility("default"))) void *malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+
+__attribute__((visibility("default"))) void *calloc(size_t count, size_t size) {
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+__attribute__((visibility("default"))) void *realloc(void *ptr, size_t size) {
+  if (size > 0) {
+    allocations++;
+  }
+  return __libc_realloc(ptr, size);
+}
+
+__attribute__((visibility("default"))) void *memalign(size_t alignment, size_t size) {
+  allocations++;
+  return __libc_memalign(alignment, size);
+}
+
+__attribute__((visibility("default"))) void *aligned_alloc(size_t alignment, size_t size) {
+  allocations++;
+  return __libc_memalign(alignment, size);
+}
+
+__attribute__((visibility("default"))) int posix_memalign(void **out, size_t alignment, size_t size) {
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  allocations++;
+  void *ptr = __libc_memalign(alignment, size);
+  if (!ptr) {
+    return ENOMEM;
+  }
+  *out = ptr;
+  return 0;
+}
+
+__attribute__((visibility("default"))) void free(void *ptr) {
+  __libc_free(ptr);
+}
+
+}
+
+/* libstdc++ would route these through malloc anyway; defining them here
+   keeps the count right when it does not. */
+static void *allocate(size_t size) {
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+__attribute__((visibility("default"))) void *operator new(size_t size) { return allocate(size); }
+__attribute__((visibility("default"))) void *operator new[](size_t size) { return allocate(size); }
+__attribute__((visibility("default"))) void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return malloc(size ? size : 1);
+}
+__attribute__((visibility("default"))) void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return malloc(size ? size : 1);
+}
+__attribute__((visibility("default"))) void operator delete(void *ptr) noexcept { free(ptr); }
+__attribute__((visibility("default"))) void operator delete[](void *ptr) noexcept { free(ptr); }
+__attribute__((visibility("default"))) void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+__attribute__((visibility("default"))) void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+__attribute__((visibility("default"))) void operator delete(void *ptr, const std::nothrow_t &) noexcept { free(ptr); }
+__attribute__((visibility("default"))) void operator delete[](void *ptr, const std::nothrow_t &) noexcept { free(ptr); }